@@ -0,0 +1,267 @@
+/*
+ ImagineKatana
+ Copyright 2014-2019 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#include "expansion_profiler.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+
+ExpansionProfiler::ExpansionProfiler() : m_enabled(false), m_topN(20), m_pCurrentType(NULL)
+{
+	for (unsigned int i = 0; i < eStageCount; i++)
+	{
+		m_stageTimes[i] = 0.0;
+	}
+}
+
+void ExpansionProfiler::setEnabled(bool enabled, unsigned int topN)
+{
+	m_enabled = enabled;
+	m_topN = topN;
+}
+
+ExpansionProfiler::ScopedLocation::ScopedLocation(ExpansionProfiler& profiler, const FnKat::FnScenegraphIterator& iterator, const std::string& type)
+	: m_profiler(profiler), m_iterator(iterator), m_active(profiler.isEnabled())
+{
+	if (m_active)
+	{
+		m_profiler.beginLocation(type);
+		m_startTime = std::chrono::steady_clock::now();
+	}
+}
+
+void ExpansionProfiler::ScopedLocation::finish()
+{
+	if (!m_active)
+		return;
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_startTime;
+	m_profiler.endLocation(m_iterator, elapsed.count());
+
+	m_active = false;
+}
+
+void ExpansionProfiler::beginLocation(const std::string& type)
+{
+	m_currentTypeName = type;
+	m_pCurrentType = &m_aTypeStats[type];
+}
+
+void ExpansionProfiler::endLocation(const FnKat::FnScenegraphIterator& iterator, double seconds)
+{
+	if (!m_pCurrentType)
+		return;
+
+	m_pCurrentType->count += 1;
+	m_pCurrentType->totalTime += seconds;
+
+	// only bother getting the location name if it's going to make it into the list
+	if (m_topN > 0)
+	{
+		if (m_aSlowestLocations.size() < m_topN)
+		{
+			m_aSlowestLocations.push_back(LocationTime(iterator.getFullName(), m_currentTypeName, seconds));
+			std::push_heap(m_aSlowestLocations.begin(), m_aSlowestLocations.end());
+		}
+		else if (seconds > m_aSlowestLocations.front().time)
+		{
+			std::pop_heap(m_aSlowestLocations.begin(), m_aSlowestLocations.end());
+			m_aSlowestLocations.back() = LocationTime(iterator.getFullName(), m_currentTypeName, seconds);
+			std::push_heap(m_aSlowestLocations.begin(), m_aSlowestLocations.end());
+		}
+	}
+
+	m_pCurrentType = NULL;
+}
+
+void ExpansionProfiler::addStageTime(Stage stage, double seconds)
+{
+	m_stageTimes[stage] += seconds;
+
+	if (m_pCurrentType)
+	{
+		m_pCurrentType->stageTimes[stage] += seconds;
+	}
+}
+
+void ExpansionProfiler::getSortedSlowestLocations(std::vector<LocationTime>& aLocations) const
+{
+	aLocations = m_aSlowestLocations;
+	// our operator< is reversed for the heap, so this gives us slowest first
+	std::sort(aLocations.begin(), aLocations.end());
+}
+
+const char* ExpansionProfiler::getStageName(Stage stage)
+{
+	switch (stage)
+	{
+		case eStageAttributeFetch:
+			return "attribute fetch";
+		case eStageConversion:
+			return "conversion";
+		case eStageMaterialLookup:
+			return "material lookup";
+		case eStageXForm:
+			return "xform";
+		case eStageIDSend:
+			return "ID send";
+		default:
+			return "unknown";
+	}
+}
+
+void ExpansionProfiler::printReport() const
+{
+	if (!m_enabled)
+		return;
+
+	fprintf(stderr, "\nScene expansion profile:\n\n");
+
+	fprintf(stderr, "%-24s %10s %12s %14s", "Location type", "Count", "Time (s)", "Attr bytes");
+	for (unsigned int i = 0; i < eStageCount; i++)
+	{
+		fprintf(stderr, " %16s", getStageName((Stage)i));
+	}
+	fprintf(stderr, "\n");
+
+	std::map<std::string, TypeStats>::const_iterator itType = m_aTypeStats.begin();
+	for (; itType != m_aTypeStats.end(); ++itType)
+	{
+		const std::string& typeName = (*itType).first;
+		const TypeStats& stats = (*itType).second;
+
+		fprintf(stderr, "%-24s %10zu %12.4f %14zu", typeName.empty() ? "<none>" : typeName.c_str(), stats.count, stats.totalTime, stats.attributeBytes);
+		for (unsigned int i = 0; i < eStageCount; i++)
+		{
+			fprintf(stderr, " %16.4f", stats.stageTimes[i]);
+		}
+		fprintf(stderr, "\n");
+	}
+
+	fprintf(stderr, "\nTotal stage times:\n");
+	for (unsigned int i = 0; i < eStageCount; i++)
+	{
+		fprintf(stderr, "%-24s %12.4f\n", getStageName((Stage)i), m_stageTimes[i]);
+	}
+
+	std::vector<LocationTime> aSlowestLocations;
+	getSortedSlowestLocations(aSlowestLocations);
+
+	if (!aSlowestLocations.empty())
+	{
+		fprintf(stderr, "\nSlowest %u locations:\n", (unsigned int)aSlowestLocations.size());
+
+		std::vector<LocationTime>::const_iterator itLocation = aSlowestLocations.begin();
+		for (; itLocation != aSlowestLocations.end(); ++itLocation)
+		{
+			const LocationTime& location = *itLocation;
+			fprintf(stderr, "%12.4f  %-16s %s\n", location.time, location.type.c_str(), location.location.c_str());
+		}
+	}
+
+	fprintf(stderr, "\n");
+}
+
+static std::string escapeJSONString(const std::string& value)
+{
+	std::string escaped;
+	escaped.reserve(value.size());
+
+	for (std::string::const_iterator itChar = value.begin(); itChar != value.end(); ++itChar)
+	{
+		char c = *itChar;
+		if (c == '"' || c == '\\')
+		{
+			escaped += '\\';
+			escaped += c;
+		}
+		else if ((unsigned char)c < 0x20)
+		{
+			escaped += ' ';
+		}
+		else
+		{
+			escaped += c;
+		}
+	}
+
+	return escaped;
+}
+
+bool ExpansionProfiler::writeJSONReport(const std::string& path) const
+{
+	if (!m_enabled)
+		return false;
+
+	FILE* pFile = fopen(path.c_str(), "w");
+	if (!pFile)
+		return false;
+
+	fprintf(pFile, "{\n\t\"locationTypes\": [\n");
+
+	std::map<std::string, TypeStats>::const_iterator itType = m_aTypeStats.begin();
+	for (; itType != m_aTypeStats.end(); ++itType)
+	{
+		const std::string& typeName = (*itType).first;
+		const TypeStats& stats = (*itType).second;
+
+		if (itType != m_aTypeStats.begin())
+		{
+			fprintf(pFile, ",\n");
+		}
+
+		fprintf(pFile, "\t\t{ \"type\": \"%s\", \"count\": %zu, \"time\": %f, \"attributeBytes\": %zu, \"stages\": {",
+				escapeJSONString(typeName).c_str(), stats.count, stats.totalTime, stats.attributeBytes);
+		for (unsigned int i = 0; i < eStageCount; i++)
+		{
+			fprintf(pFile, "%s \"%s\": %f", (i > 0) ? "," : "", getStageName((Stage)i), stats.stageTimes[i]);
+		}
+		fprintf(pFile, " } }");
+	}
+
+	fprintf(pFile, "\n\t],\n\t\"stageTotals\": {");
+	for (unsigned int i = 0; i < eStageCount; i++)
+	{
+		fprintf(pFile, "%s \"%s\": %f", (i > 0) ? "," : "", getStageName((Stage)i), m_stageTimes[i]);
+	}
+	fprintf(pFile, " },\n\t\"slowestLocations\": [\n");
+
+	std::vector<LocationTime> aSlowestLocations;
+	getSortedSlowestLocations(aSlowestLocations);
+
+	std::vector<LocationTime>::const_iterator itLocation = aSlowestLocations.begin();
+	for (; itLocation != aSlowestLocations.end(); ++itLocation)
+	{
+		const LocationTime& location = *itLocation;
+
+		if (itLocation != aSlowestLocations.begin())
+		{
+			fprintf(pFile, ",\n");
+		}
+
+		fprintf(pFile, "\t\t{ \"location\": \"%s\", \"type\": \"%s\", \"time\": %f }", escapeJSONString(location.location).c_str(),
+				escapeJSONString(location.type).c_str(), location.time);
+	}
+
+	fprintf(pFile, "\n\t]\n}\n");
+
+	fclose(pFile);
+
+	return true;
+}
@@ -0,0 +1,175 @@
+/*
+ ImagineKatana
+ Copyright 2014-2019 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#ifndef EXPANSION_PROFILER_H
+#define EXPANSION_PROFILER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include <FnScenegraphIterator/FnScenegraphIterator.h>
+
+// Optional profiler for scene expansion, accumulating wall time, attribute data sizes and counts per location
+// type and per processing stage, and keeping track of the slowest individual locations, so that it's possible
+// to see which assets are slow to expand.
+// When not enabled, the scoped helpers don't even query the clock.
+
+class ExpansionProfiler
+{
+public:
+	ExpansionProfiler();
+
+	enum Stage
+	{
+		eStageAttributeFetch,
+		eStageConversion,
+		eStageMaterialLookup,
+		eStageXForm,
+		eStageIDSend,
+		eStageCount
+	};
+
+	void setEnabled(bool enabled, unsigned int topN);
+
+	bool isEnabled() const
+	{
+		return m_enabled;
+	}
+
+	void addAttributeBytes(size_t bytes)
+	{
+		if (m_pCurrentType)
+		{
+			m_pCurrentType->attributeBytes += bytes;
+		}
+	}
+
+	void printReport() const;
+	bool writeJSONReport(const std::string& path) const;
+
+	// times a location's own processing (not including its children)
+	class ScopedLocation
+	{
+	public:
+		ScopedLocation(ExpansionProfiler& profiler, const FnKat::FnScenegraphIterator& iterator, const std::string& type);
+		~ScopedLocation()
+		{
+			finish();
+		}
+
+		// can be called early (i.e. before recursing into children) to stop timing
+		void finish();
+
+	protected:
+		ExpansionProfiler&							m_profiler;
+		const FnKat::FnScenegraphIterator&			m_iterator;
+		bool										m_active;
+		std::chrono::steady_clock::time_point		m_startTime;
+	};
+
+	class ScopedStage
+	{
+	public:
+		ScopedStage(ExpansionProfiler& profiler, Stage stage) : m_profiler(profiler), m_stage(stage), m_active(profiler.isEnabled())
+		{
+			if (m_active)
+			{
+				m_startTime = std::chrono::steady_clock::now();
+			}
+		}
+
+		~ScopedStage()
+		{
+			if (m_active)
+			{
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_startTime;
+				m_profiler.addStageTime(m_stage, elapsed.count());
+			}
+		}
+
+	protected:
+		ExpansionProfiler&							m_profiler;
+		Stage										m_stage;
+		bool										m_active;
+		std::chrono::steady_clock::time_point		m_startTime;
+	};
+
+protected:
+	struct TypeStats
+	{
+		TypeStats() : count(0), totalTime(0.0), attributeBytes(0)
+		{
+			for (unsigned int i = 0; i < eStageCount; i++)
+			{
+				stageTimes[i] = 0.0;
+			}
+		}
+
+		size_t		count;
+		double		totalTime;
+		double		stageTimes[eStageCount];
+		size_t		attributeBytes;
+	};
+
+	struct LocationTime
+	{
+		LocationTime() : time(0.0)
+		{
+		}
+
+		LocationTime(const std::string& loc, const std::string& tp, double tm) : location(loc), type(tp), time(tm)
+		{
+		}
+
+		// for min-heap ordering, so the fastest of the slow locations is always at the front
+		bool operator<(const LocationTime& rhs) const
+		{
+			return time > rhs.time;
+		}
+
+		std::string		location;
+		std::string		type;
+		double			time;
+	};
+
+	void beginLocation(const std::string& type);
+	void endLocation(const FnKat::FnScenegraphIterator& iterator, double seconds);
+
+	void addStageTime(Stage stage, double seconds);
+
+	void getSortedSlowestLocations(std::vector<LocationTime>& aLocations) const;
+
+	static const char* getStageName(Stage stage);
+
+protected:
+	bool								m_enabled;
+	unsigned int						m_topN;
+
+	std::map<std::string, TypeStats>	m_aTypeStats;
+	TypeStats*							m_pCurrentType;
+	std::string							m_currentTypeName;
+
+	double								m_stageTimes[eStageCount];
+
+	// min-heap of the slowest locations
+	std::vector<LocationTime>			m_aSlowestLocations;
+};
+
+#endif // EXPANSION_PROFILER_H
@@ -19,6 +19,9 @@
 #include "imagine_render.h"
 
 #include <stdio.h>
+#include <time.h>
+
+#include <algorithm>
 
 #include <FnRender/plugin/GlobalSettings.h>
 #include <FnRendererInfo/plugin/RenderMethod.h>
@@ -28,6 +31,7 @@
 
 #include "katana_helpers.h"
 #include "sg_location_processor.h"
+#include "texture_helpers.h"
 #include "id_state.h"
 
 // include any Imagine headers directly from the source directory as Imagine hasn't got an API yet...
@@ -49,9 +53,19 @@
 
 using namespace Imagine;
 
+// these are just waiting on I/O, so we don't want them taking render threads
+static const unsigned int kTexturePrefetchThreads = 4;
+// seconds between checks of how many renders are sharing the texture cache budget
+static const time_t kTextureBudgetCheckInterval = 5;
+
 ImagineRender::ImagineRender(FnKat::FnScenegraphIterator rootIterator, FnKat::GroupAttribute arguments) :
-	RenderBase(rootIterator, arguments), m_pScene(NULL), m_printMemoryStatistics(0), m_integratorType(1),
-	m_ambientOcclusion(false), m_fastLiveRenders(false), m_motionBlur(false),
+	RenderBase(rootIterator, arguments), m_pScene(NULL), m_printMemoryStatistics(0), m_expansionProfilingType(0), m_expansionProfilingTopN(20),
+	m_texturePreflight(false), m_textureCacheMaxSize(4096), m_textureCacheMaxFileHandles(744),
+	m_textureCacheSharedBudgetSize(0), m_lastTextureBudgetCheckTime(0),
+	m_texturePrefetch(false), m_texturePrefetchMaxSize(2048), m_pTexturePrefetcher(NULL),
+	m_integratorType(1),
+	m_ambientOcclusion(false), m_fastLiveRenders(false), m_incrementalLiveRestarts(false), m_liveProgressiveResolution(false), m_liveFoveatedRendering(false),
+	m_motionBlur(false),
 	m_ROIActive(false)
 {
 	m_pOutputImage = NULL;
@@ -62,6 +76,8 @@ ImagineRender::ImagineRender(FnKat::FnScenegraphIterator rootIterator, FnKat::Gr
 	m_pIDState = NULL;
 
 	m_pRaytracer = NULL;
+	m_pLiveLocationProcessor = NULL;
+	m_liveRenderEpoch = 0;
 
 	m_renderThreads = System::getNumberOfThreads() - 1;
 
@@ -525,15 +541,29 @@ void ImagineRender::buildSceneGeometry(Foundry::Katana::Render::RenderSettings&
 		}
 	}
 
-	SGLocationProcessor locProcessor(*m_pScene, m_logger, m_creationSettings, m_pIDState);
+	SGLocationProcessor* pLocProcessor = new SGLocationProcessor(*m_pScene, m_logger, m_creationSettings, m_pIDState);
+	SGLocationProcessor& locProcessor = *pLocProcessor;
 
 	if (renderType == eRenderLive)
 	{
 		locProcessor.setIsLiveRender(true);
 	}
 
+	if (m_expansionProfilingType != 0)
+	{
+		locProcessor.getProfiler().setEnabled(true, m_expansionProfilingTopN);
+	}
+
+	TextureRegistry::instance().clear();
+	TextureRegistry::instance().getConversionCache().setCachePath(m_textureConversionCachePath, &m_logger);
+
 	locProcessor.processSGForceExpand(rootIterator);
 
+	if (m_expansionProfilingType != 0)
+	{
+		reportExpansionProfile(locProcessor.getProfiler());
+	}
+
 	// add materials lazily
 	std::vector<Material*> aMaterials;
 	locProcessor.getFinalMaterials(aMaterials);
@@ -541,6 +571,72 @@ void ImagineRender::buildSceneGeometry(Foundry::Katana::Render::RenderSettings&
 	MaterialManager& mm = m_pScene->getMaterialManager();
 
 	mm.addMaterialsLazy(aMaterials);
+
+	if (renderType == eRenderLive)
+	{
+		// keep it (and its material caches) for any geometry edits during the live render
+		m_pLiveLocationProcessor = pLocProcessor;
+	}
+	else
+	{
+		delete pLocProcessor;
+	}
+
+	if (m_texturePreflight)
+	{
+		runTexturePreflight();
+	}
+
+	if (m_texturePrefetch)
+	{
+		// start reading texture data in the background while the acceleration structures get built
+		m_pTexturePrefetcher = new TexturePrefetcher(m_logger);
+		m_pTexturePrefetcher->start(kTexturePrefetchThreads, (size_t)m_texturePrefetchMaxSize * 1024 * 1024);
+	}
+}
+
+void ImagineRender::reportExpansionProfile(const ExpansionProfiler& profiler)
+{
+	if (m_expansionProfilingType == 2)
+	{
+		if (m_statsOutputPath.empty())
+		{
+			m_logger.warning("Expansion profiling output set to file, but no statistics output path is set - printing to console instead.");
+		}
+		else
+		{
+			// write it next to the statistics file
+			std::string profilePath = m_statsOutputPath;
+			size_t extensionPos = profilePath.rfind('.');
+			size_t separatorPos = profilePath.rfind('/');
+			if (extensionPos != std::string::npos && (separatorPos == std::string::npos || extensionPos > separatorPos))
+			{
+				profilePath = profilePath.substr(0, extensionPos);
+			}
+			profilePath += "_expansion_profile.json";
+
+			if (profiler.writeJSONReport(profilePath))
+			{
+				m_logger.info("Wrote scene expansion profile to: %s", profilePath.c_str());
+				return;
+			}
+
+			m_logger.error("Couldn't write scene expansion profile to: %s - printing to console instead.", profilePath.c_str());
+		}
+	}
+
+	profiler.printReport();
+}
+
+void ImagineRender::runTexturePreflight()
+{
+	Timer preflightTimer("Texture pre-flight", m_logger);
+
+	TexturePreflight preflight(m_logger);
+	// header reads are I/O bound, so it's worth using all available threads
+	preflight.run(std::max(1, m_renderThreads));
+
+	preflight.report(m_textureCacheMaxSize, m_textureCacheMaxFileHandles);
 }
 
 void ImagineRender::enforceSaneSceneSetup()
@@ -638,6 +734,10 @@ void ImagineRender::performLiveRender(Foundry::Katana::Render::RenderSettings& s
 
 	startInteractiveRenderer(true);
 
+	// renderFinished() never gets called for live renders, and by now the acceleration structures have been built
+	// and the first iteration's started pulling in textures itself, so there's no point prefetching any more.
+	stopTexturePrefetcher();
+
 //	renderFinished();
 }
 
@@ -741,8 +841,7 @@ void ImagineRender::startDiskRenderer()
 
 void ImagineRender::startInteractiveRenderer(bool liveRender)
 {
-	unsigned int imageFlags = COMPONENT_RGBA | COMPONENT_SAMPLES;
-	imageFlags |= m_extraAOVsFlags;
+	unsigned int imageFlags = getInteractiveImageFlags();
 
 	if (!m_ROIActive)
 	{
@@ -823,6 +922,20 @@ void ImagineRender::startInteractiveRenderer(bool liveRender)
 	}
 }
 
+void ImagineRender::stopTexturePrefetcher()
+{
+	if (!m_pTexturePrefetcher)
+		return;
+
+	m_pTexturePrefetcher->stop();
+
+	std::string prefetchedSize = formatSize(m_pTexturePrefetcher->getBytesPrefetched());
+	m_logger.info("Prefetched %s of texture data.", prefetchedSize.c_str());
+
+	delete m_pTexturePrefetcher;
+	m_pTexturePrefetcher = NULL;
+}
+
 void ImagineRender::renderFinished()
 {
 	// TODO: see if this is getting called on re-render...
@@ -892,6 +1005,48 @@ void ImagineRender::renderFinished()
 		fprintf(stderr, "Total accel structure memory size: %s\n", accelSize.c_str());
 		fprintf(stderr, "Total image texture count: %u, total image texture memory size: %s\n\n", numImages, strImageTextureSize.c_str());
 	}
+
+	stopTexturePrefetcher();
+
+	// Note: we don't wait for background texture conversions here, as that would hold up the render process exiting.
+	//       Conversions still running when it does get abandoned, and re-queued by the next render using the texture.
+
+	m_sharedTextureBudget.release();
+	m_textureCacheSharedBudgetSize = 0;
+}
+
+void ImagineRender::rebalanceTextureBudget()
+{
+	if (m_textureCacheSharedBudgetSize == 0)
+		return;
+
+	// this gets called from both the render threads (via progress) and the main thread (live restarts)
+	m_textureBudgetLock.lock();
+
+	time_t currentTime = time(NULL);
+	if (currentTime - m_lastTextureBudgetCheckTime >= kTextureBudgetCheckInterval)
+	{
+		m_lastTextureBudgetCheckTime = currentTime;
+
+		unsigned int numActiveRenders = m_sharedTextureBudget.countActiveRenders();
+		unsigned int newShare = (numActiveRenders == 0) ? m_textureCacheMaxSize :
+								SharedTextureBudget::calculateShare(m_textureCacheSharedBudgetSize, numActiveRenders);
+
+		if (newShare != m_textureCacheMaxSize)
+		{
+			m_logger.info("%u render(s) now sharing texture cache memory budget - changing texture cache limit from %u MB to %u MB.",
+						  numActiveRenders, m_textureCacheMaxSize, newShare);
+			if (newShare < SharedTextureBudget::kLowShareMB)
+			{
+				m_logger.warning("Texture cache limit is very low, so texture reads are likely to thrash.");
+			}
+
+			GlobalContext::instance().setTextureCacheMemoryLimit(newShare);
+			m_textureCacheMaxSize = newShare;
+		}
+	}
+
+	m_textureBudgetLock.unlock();
 }
 
 // progress back from the main renderer class
@@ -904,6 +1059,8 @@ void ImagineRender::progressChanged(float progress)
 		m_lastProgress = iProgress;
 		m_logger.notice("Render progress: %d%%", iProgress);
 	}
+
+	rebalanceTextureBudget();
 }
 
 DEFINE_RENDER_PLUGIN(ImagineRender)
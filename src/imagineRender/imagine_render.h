@@ -19,6 +19,9 @@
 #ifndef IMAGINE_RENDER_H
 #define IMAGINE_RENDER_H
 
+#include <atomic>
+#include <time.h>
+
 #include <FnRender/plugin/RenderBase.h>
 
 #include <FnDisplayDriver/FnKatanaDisplayDriver.h>
@@ -26,6 +29,8 @@
 
 #include "misc_helpers.h"
 #include "live_render_helpers.h"
+#include "expansion_profiler.h"
+#include "shared_texture_budget.h"
 
 namespace FnKat = Foundry::Katana;
 namespace FnKatRender = FnKat::Render;
@@ -35,8 +40,11 @@ namespace FnKatRender = FnKat::Render;
 
 #include "utils/params.h"
 #include "utils/logger.h"
+#include "utils/threads/mutex.h"
 
 class IDState;
+class SGLocationProcessor;
+class TexturePrefetcher;
 
 class ImagineRender : public Foundry::Katana::Render::RenderBase, Imagine::RaytracerHost
 {
@@ -100,7 +108,18 @@ public:
 	virtual bool hasPendingDataUpdates() const;
 	virtual int applyPendingDataUpdates();
 
-	void restartLiveRender();
+	// clearImage can be false if the accumulated samples are still valid (i.e. they've been rescaled)
+	void restartLiveRender(bool clearImage = true);
+	// quick, low-sample render of just the region, sent straight to the monitor
+	void renderLiveRegionPrepass(const LiveImageRegion& region, unsigned int sampleEdge);
+	// region prepasses of the focus region, then expanding outwards from it
+	void renderLiveFoveatedPrepasses(const LiveImageRegion& focusRegion);
+	// quick, low-sample render of the whole frame at 1/divisor resolution, upsampled and sent straight to the monitor
+	void renderLiveLowResolutionPrepass(unsigned int divisor);
+	// renders synchronously into the image with sampleEdge * sampleEdge samples per pixel
+	void renderLivePrepass(Imagine::Params& prepassSettings, Imagine::OutputImage& prepassImage, unsigned int sampleEdge);
+	// component flags the interactive OutputImage is created with
+	unsigned int getInteractiveImageFlags() const;
 
 	virtual int queueDataUpdates(FnKat::GroupAttribute updateAttribute);
 
@@ -121,6 +140,9 @@ protected:
 	void buildCamera(Foundry::Katana::Render::RenderSettings& settings, FnKat::FnScenegraphIterator cameraIterator);
 	void buildSceneGeometry(Foundry::Katana::Render::RenderSettings& settings, FnKat::FnScenegraphIterator rootIterator, RenderType renderType);
 	
+	void reportExpansionProfile(const ExpansionProfiler& profiler);
+	void runTexturePreflight();
+
 	void enforceSaneSceneSetup();
 
 	void performDiskRender(Foundry::Katana::Render::RenderSettings& settings, FnKat::FnScenegraphIterator rootIterator);
@@ -138,6 +160,12 @@ protected:
 	void startInteractiveRenderer(bool liveRender);
 	
 	void sendFullFrameToMonitor();
+	// image must already be normalised, start coordinates are in full render space
+	void sendImageRegionToMonitor(const Imagine::OutputImage& image, unsigned int startX, unsigned int startY);
+
+	void stopTexturePrefetcher();
+	// if the texture cache budget's being shared, periodically changes our share as other renders start and finish
+	void rebalanceTextureBudget();
 
 	void renderFinished();
 	
@@ -152,6 +180,13 @@ protected:
 	Imagine::Raytracer*			m_pRaytracer;
 
 	LiveRenderState				m_liveRenderState;
+	// for the live image being cleared / rescaled - separate from the update queue's own lock, so queueing updates
+	// never waits on image operations
+	Imagine::Mutex				m_liveRenderLock;
+	// incremented at the start and end of applying each batch of live updates, so it's odd while the scene's being changed
+	std::atomic<unsigned int>	m_liveRenderEpoch;
+	// kept around after the initial scene build so new / changed geometry locations can be created
+	SGLocationProcessor*		m_pLiveLocationProcessor;
 	std::string					m_renderCameraLocation;
 
 	std::string					m_diskRenderOutputPath;
@@ -178,10 +213,31 @@ protected:
 
 	std::string					m_statsOutputPath;
 	unsigned int				m_printMemoryStatistics;
+	unsigned int				m_expansionProfilingType; // 0 = off, 1 = console, 2 = JSON file next to stats output path
+	unsigned int				m_expansionProfilingTopN;
+
+	bool						m_texturePreflight;
+	unsigned int				m_textureCacheMaxSize; // in MB
+	unsigned int				m_textureCacheMaxFileHandles;
+	// released in renderFinished(), or for live renders (which are active for the whole session), on destruction
+	SharedTextureBudget			m_sharedTextureBudget;
+	unsigned int				m_textureCacheSharedBudgetSize; // in MB, the total being shared, or 0 if not sharing
+	time_t						m_lastTextureBudgetCheckTime;
+	// protects m_lastTextureBudgetCheckTime and m_textureCacheMaxSize while rendering
+	Imagine::Mutex				m_textureBudgetLock;
+	std::string					m_textureConversionCachePath;
+	bool						m_texturePrefetch;
+	unsigned int				m_texturePrefetchMaxSize; // in MB
+	TexturePrefetcher*			m_pTexturePrefetcher;
 
 	unsigned int				m_integratorType;
 	bool						m_ambientOcclusion;
 	bool						m_fastLiveRenders;
+	bool						m_incrementalLiveRestarts;
+	bool						m_liveProgressiveResolution;
+	bool						m_liveFoveatedRendering;
+	// object IDs of the last edited objects, for foveated rendering
+	std::vector<unsigned int>	m_aLiveFocusObjectIDs;
 
 	bool						m_motionBlur;
 	bool						m_frameDeterministic;
@@ -327,6 +327,11 @@ void ImagineRender::tileDone(const TileInfo& tileInfo, unsigned int threadID)
 {
 	if (!m_pOutputImage)
 		return;
+
+	// don't send tiles rendered with the previous state of the scene during live updates
+	const unsigned int liveRenderEpoch = m_liveRenderEpoch;
+	if (liveRenderEpoch & 1)
+		return;
 	
 	const unsigned int origWidth = m_pOutputImage->getWidth();
 	const unsigned int origHeight = m_pOutputImage->getHeight();
@@ -396,6 +401,18 @@ void ImagineRender::tileDone(const TileInfo& tileInfo, unsigned int threadID)
 	}
 	imageCopy.applyExposure(1.0f);
 
+	// the image might have been cleared for a restart while we were copying it
+	if (m_liveRenderEpoch != liveRenderEpoch)
+		return;
+
+	sendImageRegionToMonitor(imageCopy, tileInfo.x, tileInfo.y);
+}
+
+void ImagineRender::sendImageRegionToMonitor(const OutputImage& image, unsigned int startX, unsigned int startY)
+{
+	const unsigned int width = image.getWidth();
+	const unsigned int height = image.getHeight();
+
 	std::vector<RenderChannel>::const_iterator itRenderChannel = m_aInteractiveChannels.begin();
 	for (; itRenderChannel != m_aInteractiveChannels.end(); ++itRenderChannel)
 	{
@@ -406,14 +423,7 @@ void ImagineRender::tileDone(const TileInfo& tileInfo, unsigned int threadID)
 		if (!pNewTileMessage)
 			continue;
 
-		if (m_ROIActive)
-		{
-			pNewTileMessage->setStartCoordinates(tileInfo.x, tileInfo.y);
-		}
-		else
-		{
-			pNewTileMessage->setStartCoordinates(tileInfo.x, tileInfo.y);
-		}
+		pNewTileMessage->setStartCoordinates(startX, startY);
 		pNewTileMessage->setDataDimensions(width, height);
 
 		unsigned int skipSize = rChannel.numDstChannels * sizeof(float);
@@ -422,16 +432,11 @@ void ImagineRender::tileDone(const TileInfo& tileInfo, unsigned int threadID)
 
 		unsigned char* pDstRow = pData;
 
-		//
-		x = 0;
-		y = 0;
-		
 		if (rChannel.type == "rgba")
 		{
 			for (unsigned int i = 0; i < height; i++)
 			{
-				const Colour4f* pSrcRow = imageCopy.colourRowPtr(y + i);
-				const Colour4f* pSrcPixel = pSrcRow + x;
+				const Colour4f* pSrcPixel = image.colourRowPtr(i);
 				
 #if USE_KAT3_RGBA_ORDER
 				memcpy(pDstRow, &pSrcPixel->r, width * skipSize);
@@ -460,8 +465,7 @@ void ImagineRender::tileDone(const TileInfo& tileInfo, unsigned int threadID)
 		{		
 			for (unsigned int i = 0; i < height; i++)
 			{
-				const Colour3f* pSrcRow = imageCopy.normalRowPtr(y + i);
-				const Colour3f* pSrcPixel = pSrcRow + x;
+				const Colour3f* pSrcPixel = image.normalRowPtr(i);
 	
 				memcpy(pDstRow, &pSrcPixel->r, width * skipSize);
 	
@@ -473,8 +477,7 @@ void ImagineRender::tileDone(const TileInfo& tileInfo, unsigned int threadID)
 			// if it's ID, we need to copy it into the A channel of the ARGB channel Katana always seems to expect
 			for (unsigned int i = 0; i < height; i++)
 			{
-				const float* pSrcRow = imageCopy.idRowPtr(y + i);
-				const float* pSrcPixel = pSrcRow + x;
+				const float* pSrcPixel = image.idRowPtr(i);
 				
 				// it's ambiguous what Katana expects here - it *seems* to accept 1, 3 and 4 channel images,
 				// but it's not clear where it wants the single channel items for the ID in the latter two cases. The Arnold plugin sets
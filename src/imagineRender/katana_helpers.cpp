@@ -127,6 +127,68 @@ Foundry::Katana::RenderOutputUtils::XFormMatrixVector KatanaHelpers::getXFormMat
 	return finalValues;
 }
 
+bool KatanaHelpers::getLocalXFormMatrix(const FnKat::GroupAttribute& localXFormAttr, bool motionBlur, float shutterOpen, float shutterClose,
+										double* pMatrix, bool& isAbsolute)
+{
+	FnAttribute::DoubleAttribute matrix;
+
+	if (!motionBlur)
+	{
+		std::pair<FnAttribute::DoubleAttribute, bool> res = Foundry::Katana::FnXFormUtil::CalcTransformMatrixAtTime(localXFormAttr, 0.0f);
+		matrix = res.first;
+		isAbsolute = res.second;
+	}
+	else
+	{
+		std::pair<FnAttribute::DoubleAttribute, bool> res = FnGeolibServices::FnXFormUtil::CalcTransformMatrixAtExistingTimes(localXFormAttr);
+		matrix = FnAttribute::RemoveTimeSamplesIfAllSame(FnAttribute::RemoveTimeSamplesUnneededForShutter(res.first, shutterOpen, shutterClose));
+		isAbsolute = res.second;
+
+		if (matrix.getNumberOfTimeSamples() > 1)
+			return false;
+	}
+
+	if (!matrix.isValid())
+		return false;
+
+	FnKat::DoubleConstVector matrixValues = matrix.getNearestSample(0.0f);
+	if (matrixValues.size() != 16)
+		return false;
+
+	for (unsigned int i = 0; i < 16; i++)
+	{
+		pMatrix[i] = matrixValues[i];
+	}
+
+	return true;
+}
+
+void KatanaHelpers::concatXFormMatrices(const double* pLocal, const double* pParent, double* pResult)
+{
+	for (unsigned int row = 0; row < 4; row++)
+	{
+		for (unsigned int column = 0; column < 4; column++)
+		{
+			pResult[row * 4 + column] = pLocal[row * 4] * pParent[column] +
+										pLocal[row * 4 + 1] * pParent[4 + column] +
+										pLocal[row * 4 + 2] * pParent[8 + column] +
+										pLocal[row * 4 + 3] * pParent[12 + column];
+		}
+	}
+}
+
+bool KatanaHelpers::isIdentityXFormMatrix(const double* pMatrix)
+{
+	for (unsigned int i = 0; i < 16; i++)
+	{
+		double expected = (i % 5 == 0) ? 1.0 : 0.0;
+		if (pMatrix[i] != expected)
+			return false;
+	}
+
+	return true;
+}
+
 void KatanaHelpers::getRelevantSampleTimes(const FnKat::DataAttribute& attribute, std::vector<float>& aSampleTimes, float shutterOpen, float shutterClose)
 {
 	// we need to do this ourself...
@@ -143,6 +205,31 @@ void KatanaHelpers::getRelevantSampleTimes(const FnKat::DataAttribute& attribute
 	FnKat::RenderOutputUtils::findSampleTimesRelevantToShutterRange(aSampleTimes, sampleTimes, shutterOpen, shutterClose);
 }
 
+void KatanaHelpers::getMotionSampleTimes(const FnKat::DataAttribute& attribute, std::vector<float>& aSampleTimes, float shutterOpen, float shutterClose,
+										 unsigned int maxSegments)
+{
+	std::vector<float> aRelevantSampleTimes;
+	getRelevantSampleTimes(attribute, aRelevantSampleTimes, shutterOpen, shutterClose);
+
+	unsigned int maxSamples = (maxSegments < 1) ? 2 : maxSegments + 1;
+	unsigned int numRelevantSamples = aRelevantSampleTimes.size();
+
+	if (numRelevantSamples <= maxSamples)
+	{
+		aSampleTimes = aRelevantSampleTimes;
+		return;
+	}
+
+	// pick evenly-spaced samples (by index) from the relevant ones, so we keep the actual
+	// authored sample times rather than interpolating new ones.
+	aSampleTimes.reserve(maxSamples);
+	for (unsigned int i = 0; i < maxSamples; i++)
+	{
+		unsigned int srcIndex = (unsigned int)(((float)i * (float)(numRelevantSamples - 1) / (float)(maxSamples - 1)) + 0.5f);
+		aSampleTimes.push_back(aRelevantSampleTimes[srcIndex]);
+	}
+}
+
 
 //
 
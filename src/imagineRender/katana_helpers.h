@@ -40,7 +40,19 @@ public:
 	static Foundry::Katana::RenderOutputUtils::XFormMatrixVector getXFormMatrixMB(const FnKat::FnScenegraphIterator& iterator,
 																				  bool clampWithinShutter, float shutterOpen, float shutterClose);
 
+	// evaluates just the location's own local xform attribute. Returns false if the xform is animated within the
+	// shutter (only checked if motionBlur is true), in which case the full global xform path needs to be used.
+	static bool getLocalXFormMatrix(const FnKat::GroupAttribute& localXFormAttr, bool motionBlur, float shutterOpen, float shutterClose,
+									double* pMatrix, bool& isAbsolute);
+	// pResult = pLocal * pParent (Katana's row-vector matrix convention). pResult must not alias either input.
+	static void concatXFormMatrices(const double* pLocal, const double* pParent, double* pResult);
+	// exact comparison - Objects default to an identity transform, so these don't need setting
+	static bool isIdentityXFormMatrix(const double* pMatrix);
+
 	static void getRelevantSampleTimes(const FnKat::DataAttribute& attribute, std::vector<float>& aSampleTimes, float shutterOpen, float shutterClose);
+	// as above, but thinned down to at most (maxSegments + 1) samples, always keeping the first and last
+	static void getMotionSampleTimes(const FnKat::DataAttribute& attribute, std::vector<float>& aSampleTimes, float shutterOpen, float shutterClose,
+									 unsigned int maxSegments);
 
 };
 
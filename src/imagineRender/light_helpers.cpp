@@ -83,10 +83,93 @@ Light* LightHelpers::createLight(const FnKat::GroupAttribute& lightMaterialAttr)
 	return pNewLight;
 }
 
+bool LightHelpers::updateLight(Light* pLight, const FnKat::GroupAttribute& lightMaterialAttr)
+{
+	FnKat::StringAttribute shaderNameAttr = lightMaterialAttr.getChildByName("imagineLightShader");
+
+	if (!shaderNameAttr.isValid())
+		return false;
+
+	FnKat::GroupAttribute shaderParamsAttr = lightMaterialAttr.getChildByName("imagineLightParams");
+
+	std::string shaderName = shaderNameAttr.getValue("", false);
+
+	// the light's type has to match the shader, as we can't change the type of an existing light in place
+	if (shaderName == "Point")
+	{
+		PointLight* pPointLight = dynamic_cast<PointLight*>(pLight);
+		if (!pPointLight)
+			return false;
+
+		applyPointLightParams(pPointLight, shaderParamsAttr);
+	}
+	else if (shaderName == "Spot")
+	{
+		SpotLight* pSpotLight = dynamic_cast<SpotLight*>(pLight);
+		if (!pSpotLight)
+			return false;
+
+		applySpotLightParams(pSpotLight, shaderParamsAttr);
+	}
+	else if (shaderName == "Area")
+	{
+		AreaLight* pAreaLight = dynamic_cast<AreaLight*>(pLight);
+		if (!pAreaLight)
+			return false;
+
+		applyAreaLightParams(pAreaLight, shaderParamsAttr);
+	}
+	else if (shaderName == "Distant")
+	{
+		DistantLight* pDistantLight = dynamic_cast<DistantLight*>(pLight);
+		if (!pDistantLight)
+			return false;
+
+		applyDistantLightParams(pDistantLight, shaderParamsAttr);
+	}
+	else if (shaderName == "SkyDome")
+	{
+		SkyDome* pSkydomeLight = dynamic_cast<SkyDome*>(pLight);
+		if (!pSkydomeLight)
+			return false;
+
+		applySkydomeLightParams(pSkydomeLight, shaderParamsAttr);
+	}
+	else if (shaderName == "Environment")
+	{
+		EnvironmentLight* pEnvironmentLight = dynamic_cast<EnvironmentLight*>(pLight);
+		if (!pEnvironmentLight)
+			return false;
+
+		applyEnvironmentLightParams(pEnvironmentLight, shaderParamsAttr);
+	}
+	else if (shaderName == "PhysicalSky")
+	{
+		PhysicalSky* pPhysicalSkyLight = dynamic_cast<PhysicalSky*>(pLight);
+		if (!pPhysicalSkyLight)
+			return false;
+
+		applyPhysicalSkyLightParams(pPhysicalSkyLight, shaderParamsAttr);
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
 Light* LightHelpers::createPointLight(const FnKat::GroupAttribute& shaderParamsAttr)
 {
 	PointLight* pNewLight = new PointLight();
 
+	applyPointLightParams(pNewLight, shaderParamsAttr);
+
+	return pNewLight;
+}
+
+void LightHelpers::applyPointLightParams(PointLight* pLight, const FnKat::GroupAttribute& shaderParamsAttr)
+{
 	KatanaAttributeHelper ah(shaderParamsAttr);
 
 	float intensity = ah.getFloatParam("intensity", 1.0f);
@@ -97,19 +180,24 @@ Light* LightHelpers::createPointLight(const FnKat::GroupAttribute& shaderParamsA
 	std::string falloff = ah.getStringParam("falloff", "quadratic");
 	int falloffType = getFalloffEnumValFromString(falloff);
 
-	pNewLight->setIntensity(intensity);
-	pNewLight->setExposure(exposure);
-	pNewLight->setColour(colour);
-	pNewLight->setShadowType((Light::ShadowType)shadowTypeEnum);
-	pNewLight->setFalloffType((Light::FalloffType)falloffType);
-
-	return pNewLight;
+	pLight->setIntensity(intensity);
+	pLight->setExposure(exposure);
+	pLight->setColour(colour);
+	pLight->setShadowType((Light::ShadowType)shadowTypeEnum);
+	pLight->setFalloffType((Light::FalloffType)falloffType);
 }
 
 Light* LightHelpers::createSpotLight(const FnKat::GroupAttribute& shaderParamsAttr)
 {
 	SpotLight* pNewLight = new SpotLight();
 
+	applySpotLightParams(pNewLight, shaderParamsAttr);
+
+	return pNewLight;
+}
+
+void LightHelpers::applySpotLightParams(SpotLight* pLight, const FnKat::GroupAttribute& shaderParamsAttr)
+{
 	KatanaAttributeHelper ah(shaderParamsAttr);
 
 	float intensity = ah.getFloatParam("intensity", 1.0f);
@@ -125,24 +213,29 @@ Light* LightHelpers::createSpotLight(const FnKat::GroupAttribute& shaderParamsAt
 	float penumbraAngle = ah.getFloatParam("penumbra_angle", 5.0f);
 	bool isArea = ah.getIntParam("is_area", 1) == 1;
 
-	pNewLight->setIntensity(intensity);
-	pNewLight->setExposure(exposure);
-	pNewLight->setColour(colour);
-	pNewLight->setShadowType((Light::ShadowType)shadowTypeEnum);
-	pNewLight->setFalloffType((Light::FalloffType)falloffType);
-	pNewLight->setSamples(numSamples);
+	pLight->setIntensity(intensity);
+	pLight->setExposure(exposure);
+	pLight->setColour(colour);
+	pLight->setShadowType((Light::ShadowType)shadowTypeEnum);
+	pLight->setFalloffType((Light::FalloffType)falloffType);
+	pLight->setSamples(numSamples);
 
-	pNewLight->setConeAngle(coneAngle);
-	pNewLight->setPenumbraAngle(penumbraAngle);
-	pNewLight->setIsArea(isArea);
-
-	return pNewLight;
+	pLight->setConeAngle(coneAngle);
+	pLight->setPenumbraAngle(penumbraAngle);
+	pLight->setIsArea(isArea);
 }
 
 Light* LightHelpers::createAreaLight(const FnKat::GroupAttribute& shaderParamsAttr)
 {
 	AreaLight* pNewLight = new AreaLight();
 
+	applyAreaLightParams(pNewLight, shaderParamsAttr);
+
+	return pNewLight;
+}
+
+void LightHelpers::applyAreaLightParams(AreaLight* pLight, const FnKat::GroupAttribute& shaderParamsAttr)
+{
 	KatanaAttributeHelper ah(shaderParamsAttr);
 
 	float intensity = ah.getFloatParam("intensity", 1.0f);
@@ -162,24 +255,29 @@ Light* LightHelpers::createAreaLight(const FnKat::GroupAttribute& shaderParamsAt
 
 	bool isScale = ah.getIntParam("scale", 1) == 1;
 
-	pNewLight->setIntensity(intensity);
-	pNewLight->setExposure(exposure);
-	pNewLight->setColour(colour);
-	pNewLight->setShadowType((Light::ShadowType)shadowTypeEnum);
-	pNewLight->setFalloffType((Light::FalloffType)falloffType);
-	pNewLight->setSamples(numSamples);
-	pNewLight->setDimensions(width, depth);
-	pNewLight->setScale(isScale);
-
-	pNewLight->setShapeType((AreaLight::ShapeType)shapeTypeEnum);
+	pLight->setIntensity(intensity);
+	pLight->setExposure(exposure);
+	pLight->setColour(colour);
+	pLight->setShadowType((Light::ShadowType)shadowTypeEnum);
+	pLight->setFalloffType((Light::FalloffType)falloffType);
+	pLight->setSamples(numSamples);
+	pLight->setDimensions(width, depth);
+	pLight->setScale(isScale);
 
-	return pNewLight;
+	pLight->setShapeType((AreaLight::ShapeType)shapeTypeEnum);
 }
 
 Light* LightHelpers::createDistantLight(const FnKat::GroupAttribute& shaderParamsAttr)
 {
 	DistantLight* pNewLight = new DistantLight();
 
+	applyDistantLightParams(pNewLight, shaderParamsAttr);
+
+	return pNewLight;
+}
+
+void LightHelpers::applyDistantLightParams(DistantLight* pLight, const FnKat::GroupAttribute& shaderParamsAttr)
+{
 	KatanaAttributeHelper ah(shaderParamsAttr);
 
 	float intensity = ah.getFloatParam("intensity", 1.0f);
@@ -190,20 +288,25 @@ Light* LightHelpers::createDistantLight(const FnKat::GroupAttribute& shaderParam
 	int numSamples = ah.getIntParam("num_samples", 1);
 	float angle = ah.getFloatParam("spread_angle", 1.0f);
 
-	pNewLight->setIntensity(intensity);
-	pNewLight->setExposure(exposure);
-	pNewLight->setColour(colour);
-	pNewLight->setShadowType((Light::ShadowType)shadowTypeEnum);
-	pNewLight->setSamples(numSamples);
-	pNewLight->setSpreadAngle(angle);
-
-	return pNewLight;
+	pLight->setIntensity(intensity);
+	pLight->setExposure(exposure);
+	pLight->setColour(colour);
+	pLight->setShadowType((Light::ShadowType)shadowTypeEnum);
+	pLight->setSamples(numSamples);
+	pLight->setSpreadAngle(angle);
 }
 
 Light* LightHelpers::createSkydomeLight(const FnKat::GroupAttribute& shaderParamsAttr)
 {
 	SkyDome* pNewLight = new SkyDome();
 
+	applySkydomeLightParams(pNewLight, shaderParamsAttr);
+
+	return pNewLight;
+}
+
+void LightHelpers::applySkydomeLightParams(SkyDome* pLight, const FnKat::GroupAttribute& shaderParamsAttr)
+{
 	KatanaAttributeHelper ah(shaderParamsAttr);
 
 	float intensity = ah.getFloatParam("intensity", 1.0f);
@@ -213,20 +316,25 @@ Light* LightHelpers::createSkydomeLight(const FnKat::GroupAttribute& shaderParam
 	int shadowTypeEnum = getShadowTypeEnumValFromString(shadowType);
 	int numSamples = ah.getIntParam("num_samples", 1);
 
-	pNewLight->setIntensity(intensity);
-	pNewLight->setExposure(exposure);
-	pNewLight->setColour(colour);
-	pNewLight->setShadowType((Light::ShadowType)shadowTypeEnum);
-	pNewLight->setSamples(numSamples);
-	pNewLight->setRadius(2000.0f);
-
-	return pNewLight;
+	pLight->setIntensity(intensity);
+	pLight->setExposure(exposure);
+	pLight->setColour(colour);
+	pLight->setShadowType((Light::ShadowType)shadowTypeEnum);
+	pLight->setSamples(numSamples);
+	pLight->setRadius(2000.0f);
 }
 
 Light* LightHelpers::createEnvironmentLight(const FnKat::GroupAttribute& shaderParamsAttr)
 {
 	EnvironmentLight* pNewLight = new EnvironmentLight();
 
+	applyEnvironmentLightParams(pNewLight, shaderParamsAttr);
+
+	return pNewLight;
+}
+
+void LightHelpers::applyEnvironmentLightParams(EnvironmentLight* pLight, const FnKat::GroupAttribute& shaderParamsAttr)
+{
 	KatanaAttributeHelper ah(shaderParamsAttr);
 
 	float intensity = ah.getFloatParam("intensity", 1.0f);
@@ -238,21 +346,26 @@ Light* LightHelpers::createEnvironmentLight(const FnKat::GroupAttribute& shaderP
 
 	std::string envMapPath = ah.getStringParam("env_map_path");
 
-	pNewLight->setIntensity(intensity);
-	pNewLight->setExposure(exposure);
-	pNewLight->setShadowType((Light::ShadowType)shadowTypeEnum);
-	pNewLight->setSamples(numSamples);
-	pNewLight->setEnvMapPath(envMapPath);
-	pNewLight->setRadius(2000.0f);
-	pNewLight->setClampLuminance(clampLuminance);
-
-	return pNewLight;
+	pLight->setIntensity(intensity);
+	pLight->setExposure(exposure);
+	pLight->setShadowType((Light::ShadowType)shadowTypeEnum);
+	pLight->setSamples(numSamples);
+	pLight->setEnvMapPath(envMapPath);
+	pLight->setRadius(2000.0f);
+	pLight->setClampLuminance(clampLuminance);
 }
 
 Light* LightHelpers::createPhysicalSkyLight(const FnKat::GroupAttribute& shaderParamsAttr)
 {
 	PhysicalSky* pNewLight = new PhysicalSky();
 
+	applyPhysicalSkyLightParams(pNewLight, shaderParamsAttr);
+
+	return pNewLight;
+}
+
+void LightHelpers::applyPhysicalSkyLightParams(PhysicalSky* pLight, const FnKat::GroupAttribute& shaderParamsAttr)
+{
 	KatanaAttributeHelper ah(shaderParamsAttr);
 
 	float intensity = ah.getFloatParam("intensity", 1.0f);
@@ -272,23 +385,21 @@ Light* LightHelpers::createPhysicalSkyLight(const FnKat::GroupAttribute& shaderP
 
 	int hemisphereExtend = ah.getIntParam("hemisphere_extension", 0);
 
-	pNewLight->setIntensity(intensity);
-	pNewLight->setExposure(exposure);
-	pNewLight->setShadowType((Light::ShadowType)shadowTypeEnum);
-	pNewLight->setSamples(numSamples);
-	pNewLight->setRadius(2000.0f);
-	pNewLight->setClampLuminance(clampLuminance);
+	pLight->setIntensity(intensity);
+	pLight->setExposure(exposure);
+	pLight->setShadowType((Light::ShadowType)shadowTypeEnum);
+	pLight->setSamples(numSamples);
+	pLight->setRadius(2000.0f);
+	pLight->setClampLuminance(clampLuminance);
 
-	pNewLight->setTurbidity(turbidity);
+	pLight->setTurbidity(turbidity);
 
-	pNewLight->setDayOfYear(dayOfYear);
-	pNewLight->setTimeOfDay(time);
+	pLight->setDayOfYear(dayOfYear);
+	pLight->setTimeOfDay(time);
 
-	pNewLight->setIntensityScales(skyIntensity, sunIntensity);
+	pLight->setIntensityScales(skyIntensity, sunIntensity);
 
-	pNewLight->setHemiExtend((unsigned char)hemisphereExtend);
-
-	return pNewLight;
+	pLight->setHemiExtend((unsigned char)hemisphereExtend);
 }
 
 int LightHelpers::getFalloffEnumValFromString(const std::string& falloff)
@@ -25,6 +25,13 @@
 namespace Imagine
 {
 	class Light;
+	class PointLight;
+	class SpotLight;
+	class AreaLight;
+	class DistantLight;
+	class SkyDome;
+	class EnvironmentLight;
+	class PhysicalSky;
 }
 
 class LightHelpers
@@ -33,6 +40,8 @@ public:
 	LightHelpers();
 
 	Imagine::Light* createLight(const FnKat::GroupAttribute& lightMaterialAttr);
+	// sets all params from the material on an existing light, returning false if the light's type doesn't match the shader
+	bool updateLight(Imagine::Light* pLight, const FnKat::GroupAttribute& lightMaterialAttr);
 
 	Imagine::Light* createPointLight(const FnKat::GroupAttribute& shaderParamsAttr);
 	Imagine::Light* createSpotLight(const FnKat::GroupAttribute& shaderParamsAttr);
@@ -43,6 +52,15 @@ public:
 	Imagine::Light* createEnvironmentLight(const FnKat::GroupAttribute& shaderParamsAttr);
 	Imagine::Light* createPhysicalSkyLight(const FnKat::GroupAttribute& shaderParamsAttr);
 
+	void applyPointLightParams(Imagine::PointLight* pLight, const FnKat::GroupAttribute& shaderParamsAttr);
+	void applySpotLightParams(Imagine::SpotLight* pLight, const FnKat::GroupAttribute& shaderParamsAttr);
+	void applyAreaLightParams(Imagine::AreaLight* pLight, const FnKat::GroupAttribute& shaderParamsAttr);
+	void applyDistantLightParams(Imagine::DistantLight* pLight, const FnKat::GroupAttribute& shaderParamsAttr);
+
+	void applySkydomeLightParams(Imagine::SkyDome* pLight, const FnKat::GroupAttribute& shaderParamsAttr);
+	void applyEnvironmentLightParams(Imagine::EnvironmentLight* pLight, const FnKat::GroupAttribute& shaderParamsAttr);
+	void applyPhysicalSkyLightParams(Imagine::PhysicalSky* pLight, const FnKat::GroupAttribute& shaderParamsAttr);
+
 	static int getFalloffEnumValFromString(const std::string& falloff);
 	static int getShadowTypeEnumValFromString(const std::string& shadowType);
 	static int getAreaLightShapeTypeEnumValFromString(const std::string& shapeType);
@@ -19,9 +19,174 @@
 #include "live_render_helpers.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
 
 #include "katana_helpers.h"
 
+#include "image/output_image.h"
+
+void KatanaUpdateItem::merge(const KatanaUpdateItem& newer)
+{
+	if (newer.haveXForm)
+	{
+		haveXForm = true;
+		xform = newer.xform;
+	}
+
+	std::map<std::string, float>::const_iterator itFloat = newer.extraFloats.begin();
+	for (; itFloat != newer.extraFloats.end(); ++itFloat)
+	{
+		addExtra((*itFloat).first, (*itFloat).second);
+	}
+
+	std::map<std::string, bool>::const_iterator itBool = newer.extraBools.begin();
+	for (; itBool != newer.extraBools.end(); ++itBool)
+	{
+		addExtra((*itBool).first, (*itBool).second);
+	}
+
+	if (newer.attributes.isValid())
+	{
+		attributes = newer.attributes;
+	}
+}
+
+void LiveImageRegion::addPixel(unsigned int x, unsigned int y)
+{
+	if (!valid)
+	{
+		minX = maxX = x;
+		minY = maxY = y;
+		valid = true;
+		return;
+	}
+
+	minX = std::min(minX, x);
+	minY = std::min(minY, y);
+	maxX = std::max(maxX, x);
+	maxY = std::max(maxY, y);
+}
+
+void LiveImageRegion::addRegion(const LiveImageRegion& region)
+{
+	if (!region.valid)
+		return;
+
+	addPixel(region.minX, region.minY);
+	addPixel(region.maxX, region.maxY);
+}
+
+void LiveImageRegion::expand(unsigned int border, unsigned int imageWidth, unsigned int imageHeight)
+{
+	if (!valid)
+		return;
+
+	minX = (minX > border) ? minX - border : 0;
+	minY = (minY > border) ? minY - border : 0;
+	maxX = std::min(maxX + border, imageWidth - 1);
+	maxY = std::min(maxY + border, imageHeight - 1);
+}
+
+void LiveRenderState::addUpdate(const KatanaUpdateItem& updateItem)
+{
+	std::pair<std::string, unsigned int> updateKey(updateItem.location, (unsigned int)updateItem.type);
+
+	m_updateLock.lock();
+
+	std::map<std::pair<std::string, unsigned int>, size_t>::const_iterator itFind = m_updateItemIndices.find(updateKey);
+	if (itFind != m_updateItemIndices.end())
+	{
+		m_aUpdateItems[(*itFind).second].merge(updateItem);
+	}
+	else
+	{
+		m_updateItemIndices[updateKey] = m_aUpdateItems.size();
+		m_aUpdateItems.push_back(updateItem);
+	}
+
+	m_hasPendingUpdates.store(true, std::memory_order_release);
+
+	m_updateLock.unlock();
+}
+
+const std::vector<KatanaUpdateItem>& LiveRenderState::swapUpdates()
+{
+	// the previous front buffer's been applied, so it can be reused (keeping its capacity) as the new back buffer
+	m_aApplyItems.clear();
+
+	m_updateLock.lock();
+
+	m_aApplyItems.swap(m_aUpdateItems);
+	m_updateItemIndices.clear();
+	m_hasPendingUpdates.store(false, std::memory_order_release);
+
+	m_updateLock.unlock();
+
+	return m_aApplyItems;
+}
+
+bool LiveRenderState::hasCameraStateChanged(Imagine::HashValue stateHash) const
+{
+	return stateHash != m_lastCameraTransformHash;
+}
+
+bool LiveRenderState::hasLocationStateChanged(const std::string& location, Imagine::HashValue stateHash) const
+{
+	std::map<std::string, Imagine::HashValue>::const_iterator itFind = m_aLocationStateHashes.find(location);
+	if (itFind == m_aLocationStateHashes.end())
+		return true;
+
+	return (*itFind).second != stateHash;
+}
+
+bool LiveRenderState::hasLocationNonIntensityChanged(const std::string& location, Imagine::HashValue nonIntensityHash) const
+{
+	std::map<std::string, Imagine::HashValue>::const_iterator itFind = m_aLocationNonIntensityHashes.find(location);
+	if (itFind == m_aLocationNonIntensityHashes.end())
+		return true;
+
+	return (*itFind).second != nonIntensityHash;
+}
+
+void LiveRenderState::setCameraStateHash(Imagine::HashValue stateHash)
+{
+	m_lastCameraTransformHash = stateHash;
+}
+
+void LiveRenderState::setLocationStateHash(const std::string& location, Imagine::HashValue stateHash)
+{
+	m_aLocationStateHashes[location] = stateHash;
+}
+
+void LiveRenderState::setLocationNonIntensityHash(const std::string& location, Imagine::HashValue nonIntensityHash)
+{
+	m_aLocationNonIntensityHashes[location] = nonIntensityHash;
+}
+
+void LiveRenderState::markLocationDeleted(const std::string& location, unsigned char previousVisibilityFlags)
+{
+	// if it's already deleted, keep the original flags
+	if (m_aDeletedLocations.find(location) == m_aDeletedLocations.end())
+	{
+		m_aDeletedLocations[location] = previousVisibilityFlags;
+	}
+}
+
+bool LiveRenderState::restoreDeletedLocation(const std::string& location, unsigned char& previousVisibilityFlags)
+{
+	std::map<std::string, unsigned char>::iterator itFind = m_aDeletedLocations.find(location);
+	if (itFind == m_aDeletedLocations.end())
+		return false;
+
+	previousVisibilityFlags = (*itFind).second;
+	m_aDeletedLocations.erase(itFind);
+
+	return true;
+}
+
 void LiveRenderHelpers::setUpdateXFormFromAttribute(const FnKat::GroupAttribute& xFormUpdateAttribute, KatanaUpdateItem& updateItem)
 {
 	updateItem.xform.resize(16);
@@ -53,3 +218,226 @@ void LiveRenderHelpers::setUpdateXFormFromAttribute(const FnKat::GroupAttribute&
 		}
 	}
 }
+
+static void addStringToHash(Imagine::Hash& hash, const std::string& value)
+{
+	for (std::string::const_iterator itChar = value.begin(); itChar != value.end(); ++itChar)
+	{
+		hash.addUChar((unsigned char)*itChar);
+	}
+	// terminate it, so adjacent strings can't run into each other
+	hash.addUChar(0);
+}
+
+static void addXFormAndFlagsToHash(Imagine::Hash& hash, const KatanaUpdateItem& updateItem)
+{
+	hash.addUChar((unsigned char)updateItem.type);
+	hash.addUChar((unsigned char)updateItem.haveXForm);
+
+	if (updateItem.haveXForm)
+	{
+		// raw bits, as we're only interested in exact matches
+		std::vector<double>::const_iterator itValue = updateItem.xform.begin();
+		for (; itValue != updateItem.xform.end(); ++itValue)
+		{
+			long long bits;
+			memcpy(&bits, &(*itValue), sizeof(long long));
+			hash.addLongLong(bits);
+		}
+	}
+
+	std::map<std::string, bool>::const_iterator itBool = updateItem.extraBools.begin();
+	for (; itBool != updateItem.extraBools.end(); ++itBool)
+	{
+		addStringToHash(hash, (*itBool).first);
+		hash.addUChar((unsigned char)(*itBool).second);
+	}
+}
+
+Imagine::HashValue LiveRenderHelpers::calculateUpdateStateHash(const KatanaUpdateItem& updateItem)
+{
+	Imagine::Hash hash;
+
+	addXFormAndFlagsToHash(hash, updateItem);
+
+	std::map<std::string, float>::const_iterator itFloat = updateItem.extraFloats.begin();
+	for (; itFloat != updateItem.extraFloats.end(); ++itFloat)
+	{
+		addStringToHash(hash, (*itFloat).first);
+
+		int bits;
+		memcpy(&bits, &(*itFloat).second, sizeof(int));
+		hash.addLongLong((long long)bits);
+	}
+
+	if (updateItem.attributes.isValid())
+	{
+		// so deformations / topology changes with the same xform still get applied
+		hash.addLongLong((long long)updateItem.attributes.getHash().uint64());
+	}
+
+	return hash.getHash();
+}
+
+Imagine::HashValue LiveRenderHelpers::calculateUpdateNonIntensityHash(const KatanaUpdateItem& updateItem)
+{
+	Imagine::Hash hash;
+
+	addXFormAndFlagsToHash(hash, updateItem);
+
+	if (updateItem.attributes.isValid())
+	{
+		if (updateItem.type == KatanaUpdateItem::eTypeLight)
+		{
+			// hash each part of the material separately, so we can leave out the light's intensity and exposure
+			for (int64_t i = 0; i < updateItem.attributes.getNumberOfChildren(); i++)
+			{
+				std::string childName = updateItem.attributes.getChildName(i);
+				addStringToHash(hash, childName);
+
+				if (childName != "imagineLightParams")
+				{
+					hash.addLongLong((long long)updateItem.attributes.getChildByIndex(i).getHash().uint64());
+					continue;
+				}
+
+				FnKat::GroupAttribute paramsAttribute = updateItem.attributes.getChildByIndex(i);
+				for (int64_t j = 0; j < paramsAttribute.getNumberOfChildren(); j++)
+				{
+					std::string paramName = paramsAttribute.getChildName(j);
+					if (paramName == "intensity" || paramName == "exposure")
+						continue;
+
+					addStringToHash(hash, paramName);
+					hash.addLongLong((long long)paramsAttribute.getChildByIndex(j).getHash().uint64());
+				}
+			}
+		}
+		else
+		{
+			hash.addLongLong((long long)updateItem.attributes.getHash().uint64());
+		}
+	}
+
+	return hash.getHash();
+}
+
+float LiveRenderHelpers::calculateLightScale(float intensity, float exposure)
+{
+	return intensity * powf(2.0f, exposure);
+}
+
+bool LiveRenderHelpers::calculateObjectsImageRegion(const Imagine::OutputImage& image, const std::vector<unsigned int>& aObjectIDs,
+													 LiveImageRegion& region)
+{
+	// 0 is no object
+	std::set<float> aIDValues;
+	std::vector<unsigned int>::const_iterator itObjectID = aObjectIDs.begin();
+	for (; itObjectID != aObjectIDs.end(); ++itObjectID)
+	{
+		if (*itObjectID != 0)
+		{
+			aIDValues.insert((float)*itObjectID);
+		}
+	}
+
+	if (aIDValues.empty())
+		return false;
+
+	const unsigned int width = image.getWidth();
+	const unsigned int height = image.getHeight();
+
+	bool found = false;
+
+	// neighbouring pixels are mostly the same object, so remember the last lookup
+	float lastIDValue = 0.0f;
+	bool lastMatched = false;
+
+	for (unsigned int y = 0; y < height; y++)
+	{
+		const float* pIDPixel = image.idRowPtr(y);
+
+		for (unsigned int x = 0; x < width; x++)
+		{
+			float idValue = *pIDPixel++;
+			if (idValue != lastIDValue)
+			{
+				lastIDValue = idValue;
+				lastMatched = aIDValues.count(idValue) > 0;
+			}
+
+			if (lastMatched)
+			{
+				region.addPixel(x, y);
+				found = true;
+			}
+		}
+	}
+
+	return found;
+}
+
+void LiveRenderHelpers::rescaleImageColour(Imagine::OutputImage& image, float scale)
+{
+	const unsigned int width = image.getWidth();
+	const unsigned int height = image.getHeight();
+
+	for (unsigned int y = 0; y < height; y++)
+	{
+		Imagine::Colour4f* pPixel = image.colourRowPtr(y);
+
+		for (unsigned int x = 0; x < width; x++)
+		{
+			pPixel->r *= scale;
+			pPixel->g *= scale;
+			pPixel->b *= scale;
+
+			pPixel += 1;
+		}
+	}
+}
+
+void LiveRenderHelpers::upsampleImage(const Imagine::OutputImage& srcImage, Imagine::OutputImage& dstImage, unsigned int factor, bool haveNormals, bool haveIDs)
+{
+	const unsigned int srcWidth = srcImage.getWidth();
+	const unsigned int srcHeight = srcImage.getHeight();
+
+	const unsigned int dstWidth = dstImage.getWidth();
+	const unsigned int dstHeight = dstImage.getHeight();
+
+	for (unsigned int y = 0; y < dstHeight; y++)
+	{
+		// the last rows / columns might not be covered if the sizes weren't exact multiples
+		unsigned int srcY = std::min(y / factor, srcHeight - 1);
+
+		const Imagine::Colour4f* pSrcColourRow = srcImage.colourRowPtr(srcY);
+		Imagine::Colour4f* pDstColour = dstImage.colourRowPtr(y);
+
+		for (unsigned int x = 0; x < dstWidth; x++)
+		{
+			*pDstColour++ = pSrcColourRow[std::min(x / factor, srcWidth - 1)];
+		}
+
+		if (haveNormals)
+		{
+			const Imagine::Colour3f* pSrcNormalRow = srcImage.normalRowPtr(srcY);
+			Imagine::Colour3f* pDstNormal = dstImage.normalRowPtr(y);
+
+			for (unsigned int x = 0; x < dstWidth; x++)
+			{
+				*pDstNormal++ = pSrcNormalRow[std::min(x / factor, srcWidth - 1)];
+			}
+		}
+
+		if (haveIDs)
+		{
+			const float* pSrcIDRow = srcImage.idRowPtr(srcY);
+			float* pDstID = dstImage.idRowPtr(y);
+
+			for (unsigned int x = 0; x < dstWidth; x++)
+			{
+				*pDstID++ = pSrcIDRow[std::min(x / factor, srcWidth - 1)];
+			}
+		}
+	}
+}
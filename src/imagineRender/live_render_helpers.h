@@ -21,6 +21,9 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <set>
+#include <atomic>
 
 #include <FnAttribute/FnAttribute.h>
 
@@ -31,7 +34,7 @@
 
 namespace Imagine
 {
-class Material;
+class OutputImage;
 }
 
 struct KatanaUpdateItem
@@ -54,75 +57,137 @@ struct KatanaUpdateItem
 	};
 	
 	KatanaUpdateItem(UpdateType ty, UpdateLocationType locType, const std::string& loc) : type(ty), locationType(locType), location(loc),
-									pMaterial(NULL), haveXForm(false)
+									haveXForm(false)
 	{
 		
 	}	
 
+	void addExtra(const std::string& name, float value)
+	{
+		extra.add(name, value);
+		extraFloats[name] = value;
+	}
+
+	void addExtra(const std::string& name, bool value)
+	{
+		extra.add(name, value);
+		extraBools[name] = value;
+	}
+
+	// merges a newer update for the same location and type into this one, with the newer values taking precedence
+	void merge(const KatanaUpdateItem& newer);
+
 	UpdateType				type;
 	UpdateLocationType		locationType;
 	std::string				location;
 	
-	Imagine::Material*		pMaterial;
-	
 	bool					haveXForm;
 	std::vector<double>		xform;
 	
 	// anything extra
 	Imagine::Params			extra;
+
+	// copies of what's been added to the above, as Params can't be iterated over for merging
+	std::map<std::string, float>	extraFloats;
+	std::map<std::string, bool>		extraBools;
+
+	// for geometry changes, the full attributes of the location, and for lights and materials, the material
+	FnKat::GroupAttribute			attributes;
 };
 
 
-class LiveRenderState
+// pixel bounds within the output image
+struct LiveImageRegion
 {
-public:
-	LiveRenderState() : m_lastCameraTransformHash(0LL)
+	LiveImageRegion() : minX(0), minY(0), maxX(0), maxY(0), valid(false)
 	{
-
 	}
 
-	bool hasUpdates() const
-	{
-		// really needs a lock, but let's see how we get on without one...
-		// TODO: use an atomic value to indicate this, which is updated by below functions...
-		return !m_aUpdateItems.empty();
-	}
+	void addPixel(unsigned int x, unsigned int y);
+	void addRegion(const LiveImageRegion& region);
+	// grows the region by border pixels, clamped to the image size
+	void expand(unsigned int border, unsigned int imageWidth, unsigned int imageHeight);
 
-	void addUpdate(const KatanaUpdateItem& updateItem)
+	unsigned int getWidth() const
 	{
-		m_updateLock.lock();
-		m_aUpdateItems.push_back(updateItem);
-		m_updateLock.unlock();
+		return maxX - minX + 1;
 	}
 
-	void flushUpdates()
+	unsigned int getHeight() const
 	{
-		m_updateLock.lock();
-		m_aUpdateItems.clear();
-		m_updateLock.unlock();
+		return maxY - minY + 1;
 	}
 
-	void lock()
+	unsigned int	minX;
+	unsigned int	minY;
+	unsigned int	maxX;
+	unsigned int	maxY;
+	bool			valid;
+};
+
+// Pending live updates are double-buffered: queueDataUpdates() adds to the back buffer under the lock, and
+// applyPendingDataUpdates() swaps the buffers (O(1)) and applies the front buffer without the lock held, so
+// new updates can be queued while existing ones are being applied. Katana's polling of hasUpdates() just reads
+// an atomic flag, so never contends with either.
+
+class LiveRenderState
+{
+public:
+	LiveRenderState() : m_hasPendingUpdates(false), m_lastCameraTransformHash(0LL)
 	{
-		m_updateLock.lock();
+
 	}
 
-	void unlock()
+	bool hasUpdates() const
 	{
-		m_updateLock.unlock();
+		return m_hasPendingUpdates.load(std::memory_order_acquire);
 	}
-	
-	
 
-	std::vector<KatanaUpdateItem>::const_iterator updatesBegin() const { return m_aUpdateItems.begin(); }
-	std::vector<KatanaUpdateItem>::const_iterator updatesEnd() const { return m_aUpdateItems.end(); }
+	// coalesces the update with any existing pending one for the same location and type, so that when things are
+	// being interactively manipulated we only end up applying the latest state once
+	void addUpdate(const KatanaUpdateItem& updateItem);
+
+	// swaps the pending updates into the front buffer and returns it. Only one thread should be applying updates.
+	const std::vector<KatanaUpdateItem>& swapUpdates();
+
+	// these return true if the state of the location is different to that last applied. The set functions should
+	// only be called once the update's been successfully applied, so that if it fails, the same update being sent
+	// again isn't seen as not changing anything. They should only be called from the thread applying updates.
+	bool hasCameraStateChanged(Imagine::HashValue stateHash) const;
+	bool hasLocationStateChanged(const std::string& location, Imagine::HashValue stateHash) const;
+	bool hasLocationNonIntensityChanged(const std::string& location, Imagine::HashValue nonIntensityHash) const;
+
+	void setCameraStateHash(Imagine::HashValue stateHash);
+	void setLocationStateHash(const std::string& location, Imagine::HashValue stateHash);
+	void setLocationNonIntensityHash(const std::string& location, Imagine::HashValue nonIntensityHash);
+
+	// Imagine doesn't support removing objects from the scene, so deleted locations are made invisible, with their
+	// previous visibility remembered so that they can be restored if they're added back again. This means hidden
+	// and deleted locations can be told apart.
+	void markLocationDeleted(const std::string& location, unsigned char previousVisibilityFlags);
+	// returns true if the location was deleted, along with the visibility flags it had previously
+	bool restoreDeletedLocation(const std::string& location, unsigned char& previousVisibilityFlags);
 
 protected:
 	// for live render updates
 	Imagine::Mutex					m_updateLock;
+	std::atomic<bool>				m_hasPendingUpdates;
+
+	// back buffer, which gets added to
 	std::vector<KatanaUpdateItem>	m_aUpdateItems;
+	// (location, type) -> index in above
+	std::map<std::pair<std::string, unsigned int>, size_t>	m_updateItemIndices;
+
+	// front buffer, which is being applied
+	std::vector<KatanaUpdateItem>	m_aApplyItems;
 	
 	Imagine::HashValue				m_lastCameraTransformHash;
+	// location -> hash of the last applied xform / params
+	std::map<std::string, Imagine::HashValue>	m_aLocationStateHashes;
+	// location -> hash of everything but the intensity / exposure, so changes to just those can be detected
+	std::map<std::string, Imagine::HashValue>	m_aLocationNonIntensityHashes;
+	// location -> visibility flags before deletion
+	std::map<std::string, unsigned char>		m_aDeletedLocations;
 };
 
 class LiveRenderHelpers
@@ -130,6 +195,25 @@ class LiveRenderHelpers
 public:
 	
 	static void setUpdateXFormFromAttribute(const FnKat::GroupAttribute& xFormUpdateAttribute, KatanaUpdateItem& updateItem);
+
+	// hash of the xform and extra params of the update, so that updates which don't actually change anything can be detected
+	static Imagine::HashValue calculateUpdateStateHash(const KatanaUpdateItem& updateItem);
+	// as above, but ignoring the intensity and exposure of lights
+	static Imagine::HashValue calculateUpdateNonIntensityHash(const KatanaUpdateItem& updateItem);
+
+	// the overall radiance multiplier of a light
+	static float calculateLightScale(float intensity, float exposure);
+
+	// finds the bounds of all pixels in the image's ID AOV with any of the given object IDs, in a single pass over the image
+	static bool calculateObjectsImageRegion(const Imagine::OutputImage& image, const std::vector<unsigned int>& aObjectIDs,
+											LiveImageRegion& region);
+
+	// scales the RGB of accumulated samples, leaving alpha and sample counts alone
+	static void rescaleImageColour(Imagine::OutputImage& image, float scale);
+
+	// nearest-neighbour upsample of the colour, and the normal and ID AOVs if the images have them,
+	// so all the channels the monitor gets sent are filled in
+	static void upsampleImage(const Imagine::OutputImage& srcImage, Imagine::OutputImage& dstImage, unsigned int factor, bool haveNormals, bool haveIDs);
 };
 
 #endif // LIVE_RENDER_HELPERS_H
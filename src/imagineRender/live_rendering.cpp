@@ -18,8 +18,14 @@
 
 #include "imagine_render.h"
 
+#include <algorithm>
+#include <map>
+#include <set>
+
 #include "katana_helpers.h"
 #include "material_helper.h"
+#include "light_helpers.h"
+#include "sg_location_processor.h"
 
 // Imagine stuff
 #include "materials/material.h"
@@ -36,14 +42,14 @@ int ImagineRender::queueDataUpdates(FnKat::GroupAttribute updateAttribute)
 {
 //	fprintf(stderr, "Queue updates...\n");
 	
-	m_liveRenderState.lock();
+	m_liveRenderLock.lock();
 	if (!m_pRaytracer)
 	{
-		m_liveRenderState.unlock();
+		m_liveRenderLock.unlock();
 		return 0;
 	}
 
-	m_liveRenderState.unlock();
+	m_liveRenderLock.unlock();
 
 	unsigned int numItems = updateAttribute.getNumberOfChildren();
 
@@ -94,14 +100,14 @@ int ImagineRender::queueDataUpdates(FnKat::GroupAttribute updateAttribute)
 				if (fovAttribute.isValid())
 				{
 					double fovValue = fovAttribute.getValue(70.0, false);
-					newUpdate.extra.add("fov", (float)fovValue);
+					newUpdate.addExtra("fov", (float)fovValue);
 				}
 				
 				FnKat::DoubleAttribute nearClipAttribute = geometryAttribute.getChildByName("near");
 				if (nearClipAttribute.isValid())
 				{
 					double nearClipValue = nearClipAttribute.getValue(0.1, false);
-					newUpdate.extra.add("nearClip", (float)nearClipValue);
+					newUpdate.addExtra("nearClip", (float)nearClipValue);
 				}
 			}
 			
@@ -114,50 +120,12 @@ int ImagineRender::queueDataUpdates(FnKat::GroupAttribute updateAttribute)
 			if (!materialAttribute.isValid())
 				continue;
 			
-			FnKat::StringAttribute shaderAttribute = materialAttribute.getChildByName("imagineSurfaceShader");
-			if (shaderAttribute.isValid())
-			{
-				// we have a none-network material
-				
-				FnKat::GroupAttribute shaderParams = materialAttribute.getChildByName("imagineSurfaceParams");
-				// if all shader params are default, there won't be a group, so shaderParams will be invalid, but we can pass
-				// this down anyway. So we don't need to check for the validity of shaderParams, as its possible non-existance
-				// is okay.
-				
-				// extremely hacky for the moment...
-				KatanaUpdateItem newUpdate(KatanaUpdateItem::eTypeObjectMaterial, KatanaUpdateItem::eLocObject, location);
-				
-				std::string shaderType = shaderAttribute.getValue("", false);
-				
-				Material* pNewMaterial = MaterialHelper::createNewMaterialStandAlone(shaderType, shaderParams);
-				
-				if (pNewMaterial)
-				{
-					newUpdate.pMaterial = pNewMaterial;
-					
-					m_liveRenderState.addUpdate(newUpdate);
-				}
-				
-				continue;
-			}
+			// the material gets patched or created when the update is applied, as we can't change materials
+			// while they're being rendered with
+			KatanaUpdateItem newUpdate(KatanaUpdateItem::eTypeObjectMaterial, KatanaUpdateItem::eLocObject, location);
+			newUpdate.attributes = materialAttribute;
 			
-			FnKat::GroupAttribute nodesAttribute = materialAttribute.getChildByName("nodes");
-			if (nodesAttribute.isValid())
-			{
-				MaterialHelper materialHelper(m_logger);
-				// we have a network material
-				
-				Material* pNewMaterial = materialHelper.createNetworkMaterial(materialAttribute, false);
-				if (pNewMaterial)
-				{
-					// extremely hacky for the moment...
-					KatanaUpdateItem newUpdate(KatanaUpdateItem::eTypeObjectMaterial, KatanaUpdateItem::eLocObject, location);
-					
-					newUpdate.pMaterial = pNewMaterial;
-					
-					m_liveRenderState.addUpdate(newUpdate);
-				}
-			}
+			m_liveRenderState.addUpdate(newUpdate);
 		}
 		else if (type == "geo")
 		{
@@ -176,11 +144,19 @@ int ImagineRender::queueDataUpdates(FnKat::GroupAttribute updateAttribute)
 			if (deletedAttribute.isValid())
 			{
 				int deletedValue = deletedAttribute.getValue(0, false);
-				if (deletedValue == 1)
-				{
-					newUpdate.extra.add("deleted", true);
-					changed = true;
-				}
+				newUpdate.addExtra("deleted", deletedValue == 1);
+				changed = true;
+			}
+			
+			// new locations, or changes to topology / points
+			FnKat::GroupAttribute geometryAttribute = attributesAttribute.getChildByName("geometry");
+			if (geometryAttribute.isValid())
+			{
+				newUpdate.attributes = attributesAttribute;
+				
+				FnKat::StringAttribute locationTypeAttribute = attributesAttribute.getChildByName("type");
+				newUpdate.addExtra("subd", locationTypeAttribute.isValid() && locationTypeAttribute.getValue("", false) == "subdmesh");
+				changed = true;
 			}
 			
 			if (changed)
@@ -209,18 +185,21 @@ int ImagineRender::queueDataUpdates(FnKat::GroupAttribute updateAttribute)
 					KatanaAttributeHelper helper(shaderParamsAttribute);
 					
 					float intensity = helper.getFloatParam("intensity", 1.0f);
-					newUpdate.extra.add("intensity", intensity);
+					newUpdate.addExtra("intensity", intensity);
 					
-					float exposure = helper.getFloatParam("exposure", 1.0f);
-					newUpdate.extra.add("exposure", exposure);
+					float exposure = helper.getFloatParam("exposure", 0.0f);
+					newUpdate.addExtra("exposure", exposure);
 				}
+				
+				// all the other params get applied from this
+				newUpdate.attributes = materialAttribute;
 			}
 			
 			FnKat::IntAttribute muteAttribute = attributesAttribute.getChildByName("mute");
 			if (muteAttribute.isValid())
 			{
 				int muteValue = muteAttribute.getValue(0, false);
-				newUpdate.extra.add("muted", (bool)muteValue);
+				newUpdate.addExtra("muted", (bool)muteValue);
 			}
 			
 			m_liveRenderState.addUpdate(newUpdate);
@@ -240,15 +219,134 @@ int ImagineRender::applyPendingDataUpdates()
 {
 	m_logger.debug("applyPendingDataUpdates() called");
 	
-	m_liveRenderState.lock();
+	// any updates queued after this point go into the other buffer, and will be picked up next time
+	const std::vector<KatanaUpdateItem>& aUpdates = m_liveRenderState.swapUpdates();
+	
+	// work out which updates actually change anything: Katana often sends the same xform again (i.e. when
+	// selecting things in the viewer, or at the end of a manipulation), and there's no point in restarting
+	// the render for those.
+	std::vector<const KatanaUpdateItem*> aChangedUpdates;
+	aChangedUpdates.reserve(aUpdates.size());
+	// the new state of each of the above, which only gets recorded once it's been applied successfully
+	std::vector<HashValue> aStateHashes;
+	std::vector<HashValue> aNonIntensityHashes;
+	
+	const KatanaUpdateItem* pLightParamsOnlyUpdate = NULL;
+	
+	std::vector<KatanaUpdateItem>::const_iterator itUpdate = aUpdates.begin();
+	for (; itUpdate != aUpdates.end(); ++itUpdate)
+	{
+		const KatanaUpdateItem& update = *itUpdate;
+		
+		bool changed = true;
+		HashValue stateHash = 0;
+		HashValue nonIntensityHash = 0;
+		if (update.type == KatanaUpdateItem::eTypeCamera)
+		{
+			stateHash = LiveRenderHelpers::calculateUpdateStateHash(update);
+			changed = m_liveRenderState.hasCameraStateChanged(stateHash);
+		}
+		else if (update.type == KatanaUpdateItem::eTypeObject || update.type == KatanaUpdateItem::eTypeLight)
+		{
+			stateHash = LiveRenderHelpers::calculateUpdateStateHash(update);
+			changed = m_liveRenderState.hasLocationStateChanged(update.location, stateHash);
+			
+			if (update.type == KatanaUpdateItem::eTypeLight)
+			{
+				nonIntensityHash = LiveRenderHelpers::calculateUpdateNonIntensityHash(update);
+				bool otherChanged = m_liveRenderState.hasLocationNonIntensityChanged(update.location, nonIntensityHash);
+				if (changed && !otherChanged)
+				{
+					pLightParamsOnlyUpdate = &update;
+				}
+			}
+		}
+		
+		if (changed)
+		{
+			aChangedUpdates.push_back(&update);
+			aStateHashes.push_back(stateHash);
+			aNonIntensityHashes.push_back(nonIntensityHash);
+		}
+	}
+	
+	if (aChangedUpdates.empty())
+	{
+		m_logger.debug("Live updates don't change anything - not restarting render.");
+		return 0;
+	}
+	
+	// if the only change is to the intensity / exposure of the only light in the scene, the whole image scales
+	// linearly with it, so we can just rescale the samples accumulated so far instead of throwing them away.
+	bool rescaleImage = m_incrementalLiveRestarts && m_integratorType != 0 && aChangedUpdates.size() == 1 &&
+						aChangedUpdates[0] == pLightParamsOnlyUpdate && m_pScene->getLightCount() == 1;
+	float imageScale = 1.0f;
+	
+	// for object edits, the area the objects covered in the last image gets re-rendered quickly first
+	bool haveIDs = (m_extraAOVsFlags & COMPONENT_ID);
+	bool findDirtyRegion = (m_incrementalLiveRestarts || m_liveFoveatedRendering) && haveIDs;
+	LiveImageRegion dirtyRegion;
+	std::vector<unsigned int> aEditedObjectIDs;
+	
+	bool cameraChanged = false;
+	std::vector<const KatanaUpdateItem*>::const_iterator itCheckUpdate = aChangedUpdates.begin();
+	for (; itCheckUpdate != aChangedUpdates.end(); ++itCheckUpdate)
+	{
+		if ((*itCheckUpdate)->type == KatanaUpdateItem::eTypeCamera)
+		{
+			cameraChanged = true;
+			break;
+		}
+	}
+	
+	// odd epochs mean the scene's being changed, so any tiles finishing now are stale and get dropped by tileDone()
+	m_liveRenderEpoch++;
 	
 	// stop tracing as early as possible, so the render threads can shut down
 	m_pRaytracer->terminate();
 	
-	std::vector<KatanaUpdateItem>::const_iterator itUpdate = m_liveRenderState.updatesBegin();
-	for (; itUpdate != m_liveRenderState.updatesEnd(); ++itUpdate)
+	LightHelpers lightHelpers;
+	
+	// materials which have been patched or created in this batch of updates
+	std::set<Material*> aUpdatedMaterials;
+	// just the ones patched in place
+	std::set<Material*> aPatchedMaterials;
+	
+	// Materials are shared by all objects with the same values, so one can only be patched in place if every object using
+	// it is being edited in this batch, and they're all being changed to the same thing. Otherwise, objects which weren't
+	// edited would change as well.
+	std::map<Material*, unsigned int> aBatchMaterialUsers;
+	std::map<Material*, uint64_t> aBatchMaterialHashes;
+	std::set<Material*> aUnpatchableMaterials;
+	for (itCheckUpdate = aChangedUpdates.begin(); itCheckUpdate != aChangedUpdates.end(); ++itCheckUpdate)
 	{
-		const KatanaUpdateItem& update = *itUpdate;
+		const KatanaUpdateItem& update = *(*itCheckUpdate);
+		if (update.type != KatanaUpdateItem::eTypeObjectMaterial || !update.attributes.isValid())
+			continue;
+		
+		Object* pLocationObject = m_pScene->getObjectByName(update.location);
+		if (!pLocationObject || !pLocationObject->getMaterial())
+			continue;
+		
+		Material* pCurrentMaterial = pLocationObject->getMaterial();
+		uint64_t materialRawHash = update.attributes.getHash().uint64();
+		
+		aBatchMaterialUsers[pCurrentMaterial] += 1;
+		
+		std::map<Material*, uint64_t>::const_iterator itHash = aBatchMaterialHashes.find(pCurrentMaterial);
+		if (itHash == aBatchMaterialHashes.end())
+		{
+			aBatchMaterialHashes[pCurrentMaterial] = materialRawHash;
+		}
+		else if (itHash->second != materialRawHash)
+		{
+			aUnpatchableMaterials.insert(pCurrentMaterial);
+		}
+	}
+	
+	for (size_t updateIndex = 0; updateIndex < aChangedUpdates.size(); updateIndex++)
+	{
+		const KatanaUpdateItem& update = *aChangedUpdates[updateIndex];
 
 		if (update.type == KatanaUpdateItem::eTypeCamera)
 		{
@@ -267,8 +365,10 @@ int ImagineRender::applyPendingDataUpdates()
 				pCamera->setFOV(update.extra.getFloat("fov", 70.0f));
 				pCamera->setNearClippingPlane(update.extra.getFloat("nearClip", 0.1f));
 			}
+			
+			m_liveRenderState.setCameraStateHash(aStateHashes[updateIndex]);
 		}
-		else if (update.type == KatanaUpdateItem::eTypeObjectMaterial && update.pMaterial)
+		else if (update.type == KatanaUpdateItem::eTypeObjectMaterial && update.attributes.isValid())
 		{
 			Object* pLocationObject = m_pScene->getObjectByName(update.location);
 			
@@ -278,13 +378,86 @@ int ImagineRender::applyPendingDataUpdates()
 				continue;
 			}
 			
-			update.pMaterial->preRenderMaterial();
-			pLocationObject->setMaterial(update.pMaterial);
+			MaterialHelper& materialHelper = m_pLiveLocationProcessor->getMaterialHelper();
+			uint64_t materialRawHash = update.attributes.getHash().uint64();
+			
+			Material* pCurrentMaterial = pLocationObject->getMaterial();
+			
+			// Katana sends an update for each location using the material, but if it's patched in place for the first one,
+			// all the others will already have the change
+			if (aPatchedMaterials.count(pCurrentMaterial) > 0)
+				continue;
+			
+			bool canPatch = pCurrentMaterial && aUnpatchableMaterials.count(pCurrentMaterial) == 0 &&
+							aBatchMaterialUsers[pCurrentMaterial] == materialHelper.getMaterialUserCount(pCurrentMaterial);
+			
+			if (canPatch && materialHelper.patchMaterial(pCurrentMaterial, update.attributes, materialRawHash))
+			{
+				m_logger.debug("Patched material of object: %s in place", update.location.c_str());
+				
+				pCurrentMaterial->preRenderMaterial();
+				aUpdatedMaterials.insert(pCurrentMaterial);
+				aPatchedMaterials.insert(pCurrentMaterial);
+				continue;
+			}
+			
+			// otherwise, it's a different type or has different textures, so we need a new one. This is shared by
+			// all locations with the same material, and will be re-used if the material goes back to the same values.
+			// Matte is currently a material property, so the new one needs to keep the object's existing state.
+			bool isMatte = pCurrentMaterial && materialHelper.isMaterialMatte(pCurrentMaterial);
+			size_t numExistingMaterials = materialHelper.getMaterialsVector().size();
+			Material* pNewMaterial = materialHelper.getOrCreateMaterial(update.attributes, materialRawHash, isMatte, true);
+			
+			// it gets pre-rendered below (along with any re-used ones)
+			m_pLiveLocationProcessor->registerNewLiveMaterials(numExistingMaterials, false);
+			
+			if (!pNewMaterial)
+				continue;
+			
+			if (aUpdatedMaterials.count(pNewMaterial) == 0)
+			{
+				pNewMaterial->preRenderMaterial();
+				aUpdatedMaterials.insert(pNewMaterial);
+			}
+			
+			m_pLiveLocationProcessor->setObjectMaterial(pLocationObject, pNewMaterial);
 		}
 		else if (update.type == KatanaUpdateItem::eTypeObject)
 		{
 			Object* pLocationObject = m_pScene->getObjectByName(update.location);
 			
+			bool deleted = update.extra.getBool("deleted", false);
+			
+			// where it was in the last image - the regions for all edited objects are found together afterwards
+			if (pLocationObject && findDirtyRegion)
+			{
+				aEditedObjectIDs.push_back(pLocationObject->getObjectID());
+			}
+			
+			if (update.attributes.isValid() && !deleted)
+			{
+				bool asSubD = update.extra.getBool("subd", false);
+				
+				if (!pLocationObject)
+				{
+					m_logger.debug("Adding new object: %s", update.location.c_str());
+					
+					pLocationObject = m_pLiveLocationProcessor->addLiveMeshObject(update.location, update.attributes, asSubD);
+					
+					if (!pLocationObject)
+					{
+						m_logger.error("Couldn't create new object for location: %s", update.location.c_str());
+						continue;
+					}
+				}
+				else
+				{
+					m_logger.debug("Replacing geometry of object: %s", update.location.c_str());
+					
+					m_pLiveLocationProcessor->replaceLiveMeshGeometry(pLocationObject, update.location, update.attributes, asSubD);
+				}
+			}
+			
 			if (!pLocationObject)
 			{
 				m_logger.error("Can't find object: %s in scene in order to update its properties.", update.location.c_str());
@@ -293,25 +466,27 @@ int ImagineRender::applyPendingDataUpdates()
 			
 			m_logger.debug("Updating properties of object: %s", update.location.c_str());
 			
-			if (pLocationObject->getRenderVisibilityFlags() == 0)
+			if (deleted)
 			{
-				// we can cheat here, and assume that if we've made it invisible before, we need to add it again.
-				// This isn't really correct, as we can't tell the difference between deleted and hidden, but...
-				pLocationObject->setRenderVisibilityFlags(RENDER_VISIBILITY_FLAGS_ALL);
+				m_liveRenderState.markLocationDeleted(update.location, pLocationObject->getRenderVisibilityFlags());
+				pLocationObject->setRenderVisibilityFlags(0);
 			}
 			else
 			{
-				if (update.extra.getBool("deleted", false))
+				// only un-hide things we deleted ourselves, so locations which are just invisible stay that way
+				unsigned char previousVisibilityFlags = 0;
+				if (m_liveRenderState.restoreDeletedLocation(update.location, previousVisibilityFlags))
 				{
-					// hacky and wrong, but...
-					pLocationObject->setRenderVisibilityFlags(0);
+					pLocationObject->setRenderVisibilityFlags(previousVisibilityFlags);
 				}
-			}			
+			}
 			
 			if (update.haveXForm)
 			{
 				pLocationObject->transform().setCachedMatrix(update.xform.data(), true);
 			}
+			
+			m_liveRenderState.setLocationStateHash(update.location, aStateHashes[updateIndex]);
 		}
 		else if (update.type == KatanaUpdateItem::eTypeLight)
 		{
@@ -332,29 +507,280 @@ int ImagineRender::applyPendingDataUpdates()
 			
 			pLocationLight->setMuted(update.extra.getBool("muted", false));
 			
-			pLocationLight->setIntensity(update.extra.getFloat("intensity", 1.0f));
-			pLocationLight->setExposure(update.extra.getFloat("exposure", 1.0f));
+			float previousLightScale = LiveRenderHelpers::calculateLightScale(pLocationLight->getIntensity(), pLocationLight->getExposure());
+			
+			bool applied = true;
+			if (update.attributes.isValid())
+			{
+				if (!lightHelpers.updateLight(pLocationLight, update.attributes))
+				{
+					m_logger.warning("Couldn't update light: %s - the type of lights can't be changed during live rendering.", update.location.c_str());
+					applied = false;
+				}
+			}
+			
+			if (applied)
+			{
+				m_liveRenderState.setLocationStateHash(update.location, aStateHashes[updateIndex]);
+				m_liveRenderState.setLocationNonIntensityHash(update.location, aNonIntensityHashes[updateIndex]);
+			}
+			
+			if (rescaleImage)
+			{
+				// if the light was off, there's nothing to scale
+				if (previousLightScale > 0.0f)
+				{
+					imageScale = LiveRenderHelpers::calculateLightScale(pLocationLight->getIntensity(), pLocationLight->getExposure()) / previousLightScale;
+				}
+				else
+				{
+					rescaleImage = false;
+				}
+			}
 		}
 	}
+	
+	if (!aEditedObjectIDs.empty())
+	{
+		// the ID AOV is still that of the last image, as nothing has been rendered since the edits
+		LiveRenderHelpers::calculateObjectsImageRegion(*m_pOutputImage, aEditedObjectIDs, dirtyRegion);
+	}
+	
+	if (rescaleImage)
+	{
+		m_logger.debug("Rescaling live render image by: %f", imageScale);
+		
+		m_liveRenderLock.lock();
+		LiveRenderHelpers::rescaleImageColour(*m_pOutputImage, imageScale);
+		m_liveRenderLock.unlock();
+		
+		// so the monitor reflects the change straight away
+		OutputImage imageCopy(*m_pOutputImage);
+		imageCopy.normaliseProgressive();
+		imageCopy.applyExposure(1.0f);
+		
+		sendImageRegionToMonitor(imageCopy, m_ROIStartX, m_ROIStartY);
+		
+		restartLiveRender(false);
+		
+		return 0;
+	}
+	
+	if (m_liveProgressiveResolution)
+	{
+		// very quick coarse versions of the whole frame, so there's something to see while the full-resolution
+		// render's first iteration is going
+		renderLiveLowResolutionPrepass(8);
+		renderLiveLowResolutionPrepass(4);
+	}
+	
+	if (!aEditedObjectIDs.empty())
+	{
+		// these stay the focus for foveated rendering until other objects are edited
+		m_aLiveFocusObjectIDs = aEditedObjectIDs;
+	}
+	
+	// object regions come from the ID AOV of the last image, so if the camera's moved they're no longer where
+	// the objects are, and region prepasses would just re-render the wrong part of the frame
+	if (cameraChanged)
+	{
+		m_logger.debug("Camera changed - skipping live region prepasses.");
+	}
+	else if (m_liveFoveatedRendering && haveIDs)
+	{
+		// for other changes (i.e. light edits), focus on wherever the last edited objects were
+		LiveImageRegion focusRegion = dirtyRegion;
+		if (!focusRegion.valid)
+		{
+			LiveRenderHelpers::calculateObjectsImageRegion(*m_pOutputImage, m_aLiveFocusObjectIDs, focusRegion);
+		}
+		
+		if (focusRegion.valid)
+		{
+			renderLiveFoveatedPrepasses(focusRegion);
+		}
+	}
+	else if (dirtyRegion.valid)
+	{
+		// a bit of padding, for pixel filters and shadows / reflections immediately around the object
+		dirtyRegion.expand(8, m_pOutputImage->getWidth(), m_pOutputImage->getHeight());
+		
+		renderLiveRegionPrepass(dirtyRegion, 1);
+	}
 
-	m_liveRenderState.unlock();
+	restartLiveRender(true);
 
-	m_liveRenderState.flushUpdates();
+	return 0;
+}
 
-	restartLiveRender();
+void ImagineRender::restartLiveRender(bool clearImage)
+{
+	if (clearImage)
+	{
+		m_liveRenderLock.lock();
+	
+		m_pOutputImage->clearImage();
+	
+		m_liveRenderLock.unlock();
+	}
+	
+	m_logger.debug("Restarting render");
 
-	return 0;
+	// live renders can run for a long time, so other renders will have come and gone since the last check
+	rebalanceTextureBudget();
+	
+	// back to even, so tiles from the new render get through
+	if (m_liveRenderEpoch & 1)
+	{
+		m_liveRenderEpoch++;
+	}
+	
+	m_pRaytracer->renderScene(1.0f, &m_renderSettings, false);
 }
 
-void ImagineRender::restartLiveRender()
+void ImagineRender::renderLiveRegionPrepass(const LiveImageRegion& region, unsigned int sampleEdge)
 {
-	m_liveRenderState.lock();
+	m_logger.debug("Rendering live prepass region: (%u, %u) - (%u, %u)", region.minX, region.minY, region.maxX, region.maxY);
+	
+	// region is in OutputImage space, so needs offsetting for ROI renders
+	unsigned int cropX = region.minX + m_ROIStartX;
+	unsigned int cropY = region.minY + m_ROIStartY;
+	
+	Params prepassSettings = m_renderSettings;
+	prepassSettings.add("renderCrop", true);
+	prepassSettings.add("cropX", cropX);
+	prepassSettings.add("cropY", cropY);
+	prepassSettings.add("cropWidth", region.getWidth());
+	prepassSettings.add("cropHeight", region.getHeight());
+	
+	OutputImage prepassImage(region.getWidth(), region.getHeight(), getInteractiveImageFlags());
+	
+	renderLivePrepass(prepassSettings, prepassImage, sampleEdge);
+	
+	// the monitor keeps these pixels until the restarted render's tiles replace them
+	sendImageRegionToMonitor(prepassImage, cropX, cropY);
+}
 
-	m_pOutputImage->clearImage();
+void ImagineRender::renderLiveLowResolutionPrepass(unsigned int divisor)
+{
+	const unsigned int fullWidth = m_pOutputImage->getWidth();
+	const unsigned int fullHeight = m_pOutputImage->getHeight();
+	
+	const unsigned int prepassWidth = fullWidth / divisor;
+	const unsigned int prepassHeight = fullHeight / divisor;
+	
+	if (prepassWidth == 0 || prepassHeight == 0)
+		return;
+	
+	m_logger.debug("Rendering live 1/%u resolution prepass", divisor);
+	
+	Params prepassSettings = m_renderSettings;
+	prepassSettings.add("width", m_renderWidth / divisor);
+	prepassSettings.add("height", m_renderHeight / divisor);
+	
+	if (m_ROIActive)
+	{
+		prepassSettings.add("cropX", m_ROIStartX / divisor);
+		prepassSettings.add("cropY", m_ROIStartY / divisor);
+		prepassSettings.add("cropWidth", prepassWidth);
+		prepassSettings.add("cropHeight", prepassHeight);
+	}
+	
+	const unsigned int imageFlags = getInteractiveImageFlags();
+	
+	OutputImage prepassImage(prepassWidth, prepassHeight, imageFlags);
+	
+	renderLivePrepass(prepassSettings, prepassImage, 1);
+	
+	OutputImage upsampledImage(fullWidth, fullHeight, imageFlags);
+	LiveRenderHelpers::upsampleImage(prepassImage, upsampledImage, divisor, (imageFlags & COMPONENT_NORMAL), (imageFlags & COMPONENT_ID));
+	
+	sendImageRegionToMonitor(upsampledImage, m_ROIStartX, m_ROIStartY);
+}
 
-	m_liveRenderState.unlock();
+void ImagineRender::renderLiveFoveatedPrepasses(const LiveImageRegion& focusRegion)
+{
+	const unsigned int imageWidth = m_pOutputImage->getWidth();
+	const unsigned int imageHeight = m_pOutputImage->getHeight();
 	
-	m_logger.debug("Restarting render");
+	// the focus area itself with more samples, so what's being worked on is cleanest first
+	LiveImageRegion innerRegion = focusRegion;
+	innerRegion.expand(8, imageWidth, imageHeight);
 	
-	m_pRaytracer->renderScene(1.0f, &m_renderSettings, false);
+	renderLiveRegionPrepass(innerRegion, 2);
+	
+	// then expand outwards by half the focus area's size on each side, to give some context around it, before
+	// the full frame restarts
+	LiveImageRegion outerRegion = innerRegion;
+	outerRegion.expand(std::max(innerRegion.getWidth(), innerRegion.getHeight()) / 2, imageWidth, imageHeight);
+	
+	// only the ring around the inner region, as a whole rectangle would overwrite the better pixels above: top and
+	// bottom strips are the full width of the outer region, and the left and right ones fill in between them
+	LiveImageRegion stripRegion;
+	stripRegion.valid = true;
+	
+	if (outerRegion.minY < innerRegion.minY)
+	{
+		stripRegion.minX = outerRegion.minX;
+		stripRegion.maxX = outerRegion.maxX;
+		stripRegion.minY = outerRegion.minY;
+		stripRegion.maxY = innerRegion.minY - 1;
+		renderLiveRegionPrepass(stripRegion, 1);
+	}
+	
+	if (outerRegion.maxY > innerRegion.maxY)
+	{
+		stripRegion.minX = outerRegion.minX;
+		stripRegion.maxX = outerRegion.maxX;
+		stripRegion.minY = innerRegion.maxY + 1;
+		stripRegion.maxY = outerRegion.maxY;
+		renderLiveRegionPrepass(stripRegion, 1);
+	}
+	
+	if (outerRegion.minX < innerRegion.minX)
+	{
+		stripRegion.minX = outerRegion.minX;
+		stripRegion.maxX = innerRegion.minX - 1;
+		stripRegion.minY = innerRegion.minY;
+		stripRegion.maxY = innerRegion.maxY;
+		renderLiveRegionPrepass(stripRegion, 1);
+	}
+	
+	if (outerRegion.maxX > innerRegion.maxX)
+	{
+		stripRegion.minX = innerRegion.maxX + 1;
+		stripRegion.maxX = outerRegion.maxX;
+		stripRegion.minY = innerRegion.minY;
+		stripRegion.maxY = innerRegion.maxY;
+		renderLiveRegionPrepass(stripRegion, 1);
+	}
+}
+
+void ImagineRender::renderLivePrepass(Params& prepassSettings, OutputImage& prepassImage, unsigned int sampleEdge)
+{
+	// sampleEdge * sampleEdge samples per pixel, in one pass
+	prepassSettings.add("progressive", false);
+	prepassSettings.add("antiAliasing", sampleEdge);
+	
+	prepassImage.clearImage();
+	
+	// no host, as we don't want the tiles going through tileDone(), which reads from the main OutputImage
+	Raytracer prepassRaytracer(*m_pScene, &prepassImage, prepassSettings, false, m_renderThreads);
+	
+	if (m_integratorType == 0 && m_ambientOcclusion)
+	{
+		prepassRaytracer.setAmbientColour(Colour3f(0.7f));
+	}
+	
+	prepassRaytracer.renderScene(1.0f, NULL, true);
+	
+	prepassImage.applyExposure(1.0f);
+}
+
+unsigned int ImagineRender::getInteractiveImageFlags() const
+{
+	unsigned int imageFlags = COMPONENT_RGBA | COMPONENT_SAMPLES;
+	imageFlags |= m_extraAOVsFlags;
+	
+	return imageFlags;
 }
@@ -20,6 +20,8 @@
 
 #include <stdio.h>
 
+#include <algorithm>
+
 #include "materials/standard_material.h"
 #include "materials/glass_material.h"
 #include "materials/metal_material.h"
@@ -44,6 +46,7 @@
 #include "utils/logger.h"
 
 #include "katana_helpers.h"
+#include "texture_helpers.h"
 
 using namespace Imagine;
 
@@ -65,10 +68,15 @@ MaterialHelper::MaterialHelper(Imagine::Logger& logger) : m_logger(logger), m_pD
 
 Material* MaterialHelper::getOrCreateMaterialForLocation(const FnKat::FnScenegraphIterator& iterator, const FnKat::GroupAttribute& imagineStatements, bool fallbackToDefault)
 {
-	FnKat::GroupAttribute materialAttrib = getMaterialForLocation(iterator);
+	uint64_t materialRawHash = 0;
+	FnKat::GroupAttribute materialAttrib = getMaterialForLocationCached(iterator, materialRawHash);
 
-	Material* pMaterial = NULL;
+	return getOrCreateMaterial(materialAttrib, materialRawHash, imagineStatements, fallbackToDefault);
+}
 
+Material* MaterialHelper::getOrCreateMaterial(const FnKat::GroupAttribute& materialAttrib, uint64_t materialRawHash,
+											  const FnKat::GroupAttribute& imagineStatements, bool fallbackToDefault)
+{
 	// currently, Imagine controls whether objects are Matte from materials, so we need to inject the matte state
 	// into the Material's hash... In the future, this is likely to change and Matte will become a full object attribute/flag...
 
@@ -79,9 +87,16 @@ Material* MaterialHelper::getOrCreateMaterialForLocation(const FnKat::FnScenegra
 		isMatte = matteAttribute.getValue(0, false) == 1;
 	}
 
-	FnAttribute::Hash materialRawHash = materialAttrib.getHash();
+	return getOrCreateMaterial(materialAttrib, materialRawHash, isMatte, fallbackToDefault);
+}
+
+Material* MaterialHelper::getOrCreateMaterial(const FnKat::GroupAttribute& materialAttrib, uint64_t materialRawHash, bool isMatte,
+											  bool fallbackToDefault)
+{
+	Material* pMaterial = NULL;
+
 	Hash hash;
-	hash.addLongLong(materialRawHash.uint64());
+	hash.addLongLong(materialRawHash);
 	hash.addUChar((unsigned char)isMatte);
 	HashValue materialHash = hash.getHash();
 
@@ -103,6 +118,18 @@ Material* MaterialHelper::getOrCreateMaterialForLocation(const FnKat::FnScenegra
 		// add this new material to our list of material instances
 		m_aMaterialInstances[materialHash] = pMaterial;
 		m_aMaterials.push_back(pMaterial);
+
+		if (pMaterial != m_pDefaultMaterial && pMaterial != m_pDefaultMaterialMatte)
+		{
+			HashValue templateHash = calculateTemplateHash(materialAttrib, isMatte);
+			m_aTemplateVariantCounts[templateHash] += 1;
+			m_aMaterialTemplates[pMaterial] = templateHash;
+
+			if (isMatte)
+			{
+				m_aMatteMaterials.insert(pMaterial);
+			}
+		}
 	}
 
 	return pMaterial;
@@ -116,6 +143,274 @@ FnKat::GroupAttribute MaterialHelper::getMaterialForLocation(const FnKat::FnScen
 	return FnKat::RenderOutputUtils::getFlattenedMaterialAttr(iterator, m_terminatorNodes);
 }
 
+HashValue MaterialHelper::calculateTemplateHash(const FnKat::GroupAttribute& materialAttrib, bool isMatte)
+{
+	Hash hash;
+	hash.addUChar((unsigned char)isMatte);
+
+	FnKat::StringAttribute shaderNameAttr = materialAttrib.getChildByName("imagineSurfaceShader");
+	if (!shaderNameAttr.isValid())
+	{
+		// network materials can have arbitrary structure, so every unique one is its own template
+		hash.addLongLong(materialAttrib.getHash().uint64());
+		return hash.getHash();
+	}
+
+	hash.addLongLong(shaderNameAttr.getHash().uint64());
+
+	// texture paths (the only string params) are part of the template, the other values aren't
+	FnKat::GroupAttribute shaderParamsAttr = materialAttrib.getChildByName("imagineSurfaceParams");
+	if (shaderParamsAttr.isValid())
+	{
+		unsigned int numParams = shaderParamsAttr.getNumberOfChildren();
+		for (unsigned int i = 0; i < numParams; i++)
+		{
+			FnKat::StringAttribute stringParamAttr = shaderParamsAttr.getChildByIndex(i);
+			if (!stringParamAttr.isValid())
+				continue;
+
+			FnKat::StringAttribute paramNameAttr(shaderParamsAttr.getChildName(i));
+			hash.addLongLong(paramNameAttr.getHash().uint64());
+			hash.addLongLong(stringParamAttr.getHash().uint64());
+		}
+	}
+
+	FnKat::GroupAttribute bumpParamsAttr = materialAttrib.getChildByName("imagineBumpParams");
+	if (bumpParamsAttr.isValid())
+	{
+		hash.addLongLong(bumpParamsAttr.getHash().uint64());
+	}
+
+	FnKat::GroupAttribute alphaParamsAttr = materialAttrib.getChildByName("imagineAlphaParams");
+	if (alphaParamsAttr.isValid())
+	{
+		hash.addLongLong(alphaParamsAttr.getHash().uint64());
+	}
+
+	return hash.getHash();
+}
+
+bool MaterialHelper::isMaterialMatte(const Material* pMaterial) const
+{
+	if (pMaterial == m_pDefaultMaterialMatte)
+		return true;
+
+	return m_aMatteMaterials.find(pMaterial) != m_aMatteMaterials.end();
+}
+
+void MaterialHelper::addMaterialUser(const Material* pMaterial)
+{
+	if (!pMaterial)
+		return;
+
+	m_aMaterialUserCounts[pMaterial] += 1;
+}
+
+void MaterialHelper::removeMaterialUser(const Material* pMaterial)
+{
+	std::map<const Material*, unsigned int>::iterator itFind = m_aMaterialUserCounts.find(pMaterial);
+	if (itFind == m_aMaterialUserCounts.end())
+		return;
+
+	if (itFind->second <= 1)
+	{
+		m_aMaterialUserCounts.erase(itFind);
+	}
+	else
+	{
+		itFind->second -= 1;
+	}
+}
+
+unsigned int MaterialHelper::getMaterialUserCount(const Material* pMaterial) const
+{
+	std::map<const Material*, unsigned int>::const_iterator itFind = m_aMaterialUserCounts.find(pMaterial);
+	if (itFind == m_aMaterialUserCounts.end())
+		return 0;
+
+	return itFind->second;
+}
+
+HashValue MaterialHelper::getMaterialTemplateHash(const Material* pMaterial)
+{
+	std::map<const Material*, HashValue>::const_iterator itFind = m_aMaterialTemplates.find(pMaterial);
+	if (itFind == m_aMaterialTemplates.end())
+		return 0;
+
+	return (*itFind).second;
+}
+
+bool MaterialHelper::patchMaterial(Material* pMaterial, const FnKat::GroupAttribute& materialAttrib, uint64_t materialRawHash)
+{
+	HashValue existingTemplateHash = getMaterialTemplateHash(pMaterial);
+	if (existingTemplateHash == 0)
+		return false;
+
+	// a material edit can't change whether the object is matte, so it can be either
+	bool isMatte = false;
+	if (calculateTemplateHash(materialAttrib, false) != existingTemplateHash)
+	{
+		if (calculateTemplateHash(materialAttrib, true) != existingTemplateHash)
+			return false;
+
+		isMatte = true;
+	}
+
+	// network materials are always their own template, so can't get here
+	FnKat::StringAttribute shaderNameAttr = materialAttrib.getChildByName("imagineSurfaceShader");
+	std::string shaderName = shaderNameAttr.getValue("", false);
+
+	FnKat::GroupAttribute shaderParamsAttr = materialAttrib.getChildByName("imagineSurfaceParams");
+	FnKat::GroupAttribute bumpParamsAttr = materialAttrib.getChildByName("imagineBumpParams");
+	FnKat::GroupAttribute alphaParamsAttr = materialAttrib.getChildByName("imagineAlphaParams");
+
+	// the template hash includes the shader name, so these casts should always succeed, but...
+	if (shaderName == "Standard" || shaderName == "StandardImage")
+	{
+		StandardMaterial* pStandardMaterial = dynamic_cast<StandardMaterial*>(pMaterial);
+		if (!pStandardMaterial)
+			return false;
+
+		applyStandardMaterialParams(pStandardMaterial, shaderParamsAttr, bumpParamsAttr, alphaParamsAttr, false);
+	}
+	else if (shaderName == "Glass")
+	{
+		GlassMaterial* pGlassMaterial = dynamic_cast<GlassMaterial*>(pMaterial);
+		if (!pGlassMaterial)
+			return false;
+
+		applyGlassMaterialParams(pGlassMaterial, shaderParamsAttr, false);
+	}
+	else if (shaderName == "Metal")
+	{
+		MetalMaterial* pMetalMaterial = dynamic_cast<MetalMaterial*>(pMaterial);
+		if (!pMetalMaterial)
+			return false;
+
+		applyMetalMaterialParams(pMetalMaterial, shaderParamsAttr, bumpParamsAttr, false);
+	}
+	else if (shaderName == "Plastic")
+	{
+		PlasticMaterial* pPlasticMaterial = dynamic_cast<PlasticMaterial*>(pMaterial);
+		if (!pPlasticMaterial)
+			return false;
+
+		applyPlasticMaterialParams(pPlasticMaterial, shaderParamsAttr, bumpParamsAttr, false);
+	}
+	else if (shaderName == "Brushed Metal")
+	{
+		BrushedMetalMaterial* pBrushedMetalMaterial = dynamic_cast<BrushedMetalMaterial*>(pMaterial);
+		if (!pBrushedMetalMaterial)
+			return false;
+
+		applyBrushedMetalMaterialParams(pBrushedMetalMaterial, shaderParamsAttr, bumpParamsAttr, false);
+	}
+	else if (shaderName == "Metallic Paint")
+	{
+		MetallicPaintMaterial* pMetallicPaintMaterial = dynamic_cast<MetallicPaintMaterial*>(pMaterial);
+		if (!pMetallicPaintMaterial)
+			return false;
+
+		applyMetallicPaintMaterialParams(pMetallicPaintMaterial, shaderParamsAttr, bumpParamsAttr, false);
+	}
+	else if (shaderName == "Translucent")
+	{
+		TranslucentMaterial* pTranslucentMaterial = dynamic_cast<TranslucentMaterial*>(pMaterial);
+		if (!pTranslucentMaterial)
+			return false;
+
+		applyTranslucentMaterialParams(pTranslucentMaterial, shaderParamsAttr, bumpParamsAttr, false);
+	}
+	else if (shaderName == "Velvet")
+	{
+		VelvetMaterial* pVelvetMaterial = dynamic_cast<VelvetMaterial*>(pMaterial);
+		if (!pVelvetMaterial)
+			return false;
+
+		applyVelvetMaterialParams(pVelvetMaterial, shaderParamsAttr, false);
+	}
+	else
+	{
+		// Luminous materials can register themselves as lights at scene build time, so they always need re-creating
+		return false;
+	}
+
+	// re-key the material under its new values, so the old values don't find it any more, and the new ones don't
+	// create a duplicate
+	Hash hash;
+	hash.addLongLong(materialRawHash);
+	hash.addUChar((unsigned char)isMatte);
+	HashValue newMaterialHash = hash.getHash();
+
+	std::map<HashValue, Material*>::iterator itInstance = m_aMaterialInstances.begin();
+	while (itInstance != m_aMaterialInstances.end())
+	{
+		if ((*itInstance).second == pMaterial)
+		{
+			m_aMaterialInstances.erase(itInstance++);
+		}
+		else
+		{
+			++itInstance;
+		}
+	}
+
+	m_aMaterialInstances[newMaterialHash] = pMaterial;
+
+	return true;
+}
+
+void MaterialHelper::printStatistics() const
+{
+	if (m_aMaterialTemplates.empty())
+		return;
+
+	unsigned int maxVariants = 0;
+	std::map<HashValue, unsigned int>::const_iterator itTemplate = m_aTemplateVariantCounts.begin();
+	for (; itTemplate != m_aTemplateVariantCounts.end(); ++itTemplate)
+	{
+		maxVariants = std::max(maxVariants, (*itTemplate).second);
+	}
+
+	m_logger.debug("Materials: %u unique materials from %u unique templates (max %u variants of one template).",
+				   (unsigned int)m_aMaterialTemplates.size(), (unsigned int)m_aTemplateVariantCounts.size(), maxVariants);
+}
+
+FnKat::GroupAttribute MaterialHelper::getMaterialForLocationCached(const FnKat::FnScenegraphIterator& iterator, uint64_t& materialRawHash)
+{
+	// the flattened material is fully determined by the material location it's assigned to and any (inherited) material
+	// attributes at this location overriding or adding to that, so that's what we key the cache on.
+	FnKat::StringAttribute materialAssignAttribute = iterator.getAttribute("materialAssign", true);
+	FnKat::GroupAttribute localMaterialAttribute = iterator.getAttribute("material", true);
+
+	Hash hash;
+	if (materialAssignAttribute.isValid())
+	{
+		hash.addLongLong(materialAssignAttribute.getHash().uint64());
+	}
+	hash.addUChar((unsigned char)materialAssignAttribute.isValid());
+	if (localMaterialAttribute.isValid())
+	{
+		hash.addLongLong(localMaterialAttribute.getHash().uint64());
+	}
+	hash.addUChar((unsigned char)localMaterialAttribute.isValid());
+	HashValue assignmentHash = hash.getHash();
+
+	std::map<HashValue, FlattenedMaterial>::const_iterator itFind = m_aFlattenedMaterials.find(assignmentHash);
+	if (itFind != m_aFlattenedMaterials.end())
+	{
+		materialRawHash = (*itFind).second.rawHash;
+		return (*itFind).second.attribute;
+	}
+
+	FlattenedMaterial& newItem = m_aFlattenedMaterials[assignmentHash];
+	newItem.attribute = getMaterialForLocation(iterator);
+	newItem.rawHash = newItem.attribute.getHash().uint64();
+
+	materialRawHash = newItem.rawHash;
+	return newItem.attribute;
+}
+
 Material* MaterialHelper::createNewMaterial(const FnKat::GroupAttribute& attribute, bool isMatte, bool fallbackToDefault)
 {
 	// only add to map if we created material and attribute had a valid material, otherwise, return default
@@ -207,11 +502,6 @@ Material* MaterialHelper::createNewMaterial(const FnKat::GroupAttribute& attribu
 	}
 }
 
-Material* MaterialHelper::createNewMaterialStandAlone(const std::string& materialType, const FnKat::GroupAttribute& shaderParamsAttr)
-{
-	return createMaterial(materialType, shaderParamsAttr);
-}
-
 // TODO: this whole infrastructure for handling Network Materials is pretty hacky...
 Material* MaterialHelper::createNetworkMaterial(const FnKat::GroupAttribute& attribute, bool isMatte)
 {
@@ -236,213 +526,296 @@ Material* MaterialHelper::createNetworkMaterial(const FnKat::GroupAttribute& att
 		return NULL;
 	}
 
-	std::map<std::string, Material*> aMaterialNodes; // there should really only be one of these, but...
-	std::map<std::string, Texture*> aOpNodes;
-	std::map<std::string, Texture*> aTextureNodes;
-
-	Material* pNewNodeMaterial = NULL;
+	// compile the network into a flat list of nodes with resolved connections, so we only do the string
+	// parsing and name lookups once
+	std::vector<NetworkNode> aNodes;
+	if (!compileNetworkNodes(nodesAttr, aNodes))
+		return NULL;
 
-	// process all node items and cache them by name...
-	unsigned int numNodes = nodesAttr.getNumberOfChildren();
-	for (unsigned int i = 0; i < numNodes; i++)
+	// work out which node is the surface shader: use the terminal if we can, otherwise fall back to the last shader node
+	int materialNodeIndex = -1;
+	std::string surfaceTerminalNodeName = imagineSurfaceAttr.getValue("", false);
+	for (unsigned int i = 0; i < aNodes.size(); i++)
 	{
-		FnKat::GroupAttribute subItem = nodesAttr.getChildByIndex(i);
+		if (aNodes[i].category != NetworkNode::eShader)
+			continue;
 
-		KatanaAttributeHelper ah(subItem);
+		if (materialNodeIndex == -1 || aNodes[materialNodeIndex].name != surfaceTerminalNodeName)
+		{
+			materialNodeIndex = (int)i;
+		}
+	}
 
-		std::string nodeName = ah.getStringParam("name", "");
-		std::string nodeType = ah.getStringParam("type", "");
+	if (materialNodeIndex == -1)
+		return NULL;
 
-		bool isShader = nodeType.find("Shader/") != std::string::npos;
-		bool isOp = nodeType.find("Op/") != std::string::npos;
-		bool isTexture = nodeType.find("Texture/") != std::string::npos;
-		bool isNonNetworkShaderType = isRecognisedShaderType(nodeType);
+	// sort the nodes the material depends on so that all inputs are built before the nodes using them. Anything not
+	// connected to the material doesn't get built at all.
+	std::vector<unsigned int> aSortedNodes;
+	std::vector<unsigned char> aVisitState(aNodes.size(), 0);
+	if (!sortNetworkNodes(aNodes, (unsigned int)materialNodeIndex, aVisitState, aSortedNodes))
+	{
+		m_logger.error("Network material contains a cycle - ignoring.");
+		return NULL;
+	}
 
-		if (!isShader && !isOp && !isTexture && !isNonNetworkShaderType)
-		{
-			// if we don't know what it is, it's probably not for us, so just skip it
-			m_logger.warning("Unknown network material type: %s", nodeType.c_str());
-			continue;
-		}
+	unsigned int numFolded = 0;
 
-		FnKat::GroupAttribute paramsAttr = subItem.getChildByName("parameters");
+	std::vector<unsigned int>::const_iterator itNodeIndex = aSortedNodes.begin();
+	for (; itNodeIndex != aSortedNodes.end(); ++itNodeIndex)
+	{
+		NetworkNode& node = aNodes[*itNodeIndex];
 
-		if (isNonNetworkShaderType)
+		if (node.category == NetworkNode::eTexture)
 		{
-			// it wasn't actually a network shader, Katana just puts it in that group because that location inherited
-			// network materials from higher up
-			pNewNodeMaterial = createMaterial(nodeType, paramsAttr);
-
-			if (!pNewNodeMaterial)
+			if (node.typeName == "Constant")
+			{
+				// don't create these unless something actually needs a Texture...
+				node.isConstant = true;
+				node.constantColour = KatanaAttributeHelper::getColourParam(node.params, "colour", Colour3f(0.6f, 0.6f, 0.6f));
+				numFolded++;
 				continue;
+			}
 
-			aMaterialNodes[nodeName] = pNewNodeMaterial;
+			node.pTexture = createNetworkTextureItem(node.typeName, node.params);
 		}
-		else if (isShader)
+		else if (node.category == NetworkNode::eOp)
 		{
-			std::string shaderType = nodeType.substr(7);
+			// constant-fold a Mix of two constants with a constant mix amount
+			if (node.typeName == "Mix")
+			{
+				const NetworkNode* pInputA = findNetworkNodeInput(aNodes, node, "input_A");
+				const NetworkNode* pInputB = findNetworkNodeInput(aNodes, node, "input_B");
+				const NetworkNode* pMixAmount = findNetworkNodeInput(aNodes, node, "mix_amount");
 
-			pNewNodeMaterial = createMaterial(shaderType, paramsAttr);
+				if (pInputA && pInputA->isConstant && pInputB && pInputB->isConstant && !pMixAmount)
+				{
+					float mixValue = KatanaAttributeHelper::getFloatParam(node.params, "mix_value", 0.5f);
+
+					node.isConstant = true;
+					node.constantColour = pInputA->constantColour * (1.0f - mixValue) + pInputB->constantColour * mixValue;
+					numFolded++;
+					continue;
+				}
+			}
 
-			if (!pNewNodeMaterial)
+			node.pTexture = createNetworkOpItem(node.typeName, node.params);
+			if (!node.pTexture)
 				continue;
 
-			aMaterialNodes[nodeName] = pNewNodeMaterial;
+			std::vector<NetworkConnection>::const_iterator itInput = node.inputs.begin();
+			for (; itInput != node.inputs.end(); ++itInput)
+			{
+				const NetworkConnection& input = *itInput;
+
+				const Texture* pSourceTexture = getNetworkNodeTexture(aNodes[input.sourceNodeIndex]);
+				if (pSourceTexture)
+				{
+					connectOpToOp(node.pTexture, node.typeName, input.paramName, pSourceTexture);
+				}
+			}
 		}
-		else if (isOp)
+		else if (node.category == NetworkNode::eShader)
 		{
-			std::string opName = nodeType.substr(3);
-
-			Texture* pNewNodeOp = createNetworkOpItem(opName, paramsAttr);
-			if (!pNewNodeOp)
+			node.pMaterial = createMaterial(node.typeName, node.params);
+			if (!node.pMaterial)
 				continue;
 
-			aOpNodes[nodeName] = pNewNodeOp;
-		}
-		else if (isTexture)
-		{
-			std::string textureName = nodeType.substr(8);
+			std::vector<NetworkConnection>::const_iterator itInput = node.inputs.begin();
+			for (; itInput != node.inputs.end(); ++itInput)
+			{
+				const NetworkConnection& input = *itInput;
+				NetworkNode& sourceNode = aNodes[input.sourceNodeIndex];
 
-			Texture* pNewNodeTexture = createNetworkTextureItem(textureName, paramsAttr);
-			if (!pNewNodeTexture)
-				continue;
+				// if the input is constant, set it directly on the material if we can, so no texture lookup is needed
+				if (sourceNode.isConstant && setMaterialConstantColour(node.pMaterial, node.typeName, input.paramName, sourceNode.constantColour))
+					continue;
 
-			aTextureNodes[nodeName] = pNewNodeTexture;
+				const Texture* pSourceTexture = getNetworkNodeTexture(sourceNode);
+				if (pSourceTexture)
+				{
+					connectTextureToMaterial(node.pMaterial, node.typeName, input.paramName, pSourceTexture);
+				}
+			}
 		}
 	}
 
-	if (!pNewNodeMaterial)
-		return NULL;
+	Material* pNewNodeMaterial = aNodes[materialNodeIndex].pMaterial;
+
+	if (pNewNodeMaterial)
+	{
+		m_logger.debug("Compiled network material: %u nodes, %u used, %u constant-folded.", (unsigned int)aNodes.size(),
+					   (unsigned int)aSortedNodes.size(), numFolded);
+	}
+
+	return pNewNodeMaterial;
+}
+
+bool MaterialHelper::compileNetworkNodes(const FnKat::GroupAttribute& nodesAttr, std::vector<NetworkNode>& aNodes)
+{
+	std::map<std::string, unsigned int> aNodeIndices;
 
-	// now that we've gone through all nodes and created them, we can go through again, looking for
-	// connections, and connect them up
+	// first pass: classify all nodes we know about...
+	unsigned int numNodes = nodesAttr.getNumberOfChildren();
+	aNodes.reserve(numNodes);
 	for (unsigned int i = 0; i < numNodes; i++)
 	{
 		FnKat::GroupAttribute subItem = nodesAttr.getChildByIndex(i);
 
 		KatanaAttributeHelper ah(subItem);
 
-		FnKat::GroupAttribute connectionsAttr = subItem.getChildByName("connections");
-		if (!connectionsAttr.isValid())
-			continue;
-
 		std::string nodeName = ah.getStringParam("name", "");
 		std::string nodeType = ah.getStringParam("type", "");
 
-		bool isShader = nodeType.find("Shader/") != std::string::npos;
-//		bool isOp = nodeType.find("Op/") != std::string::npos;
-
-		unsigned int numConnections = connectionsAttr.getNumberOfChildren();
+		NetworkNode newNode;
+		newNode.name = nodeName;
+		newNode.params = subItem.getChildByName("parameters");
+		newNode.connections = subItem.getChildByName("connections");
 
-		if (isShader)
+		if (isRecognisedShaderType(nodeType))
+		{
+			// it wasn't actually a network shader, Katana just puts it in that group because that location inherited
+			// network materials from higher up
+			newNode.category = NetworkNode::eShader;
+			newNode.typeName = nodeType;
+		}
+		else if (nodeType.compare(0, 7, "Shader/") == 0)
+		{
+			newNode.category = NetworkNode::eShader;
+			newNode.typeName = nodeType.substr(7);
+		}
+		else if (nodeType.compare(0, 3, "Op/") == 0)
 		{
-			// we're connecting a Texture Op into this shader as an input
-			std::string shaderName = nodeType.substr(7);
+			newNode.category = NetworkNode::eOp;
+			newNode.typeName = nodeType.substr(3);
+		}
+		else if (nodeType.compare(0, 8, "Texture/") == 0)
+		{
+			newNode.category = NetworkNode::eTexture;
+			newNode.typeName = nodeType.substr(8);
+		}
+		else
+		{
+			// if we don't know what it is, it's probably not for us, so just skip it
+			m_logger.warning("Unknown network material type: %s", nodeType.c_str());
+			continue;
+		}
 
-			Material* pMaterial = aMaterialNodes[nodeName];
+		aNodeIndices[nodeName] = (unsigned int)aNodes.size();
+		aNodes.push_back(newNode);
+	}
 
-			for (unsigned int j = 0; j < numConnections; j++)
-			{
-				std::string paramName = connectionsAttr.getChildName(j);
+	// second pass: resolve connections to node indices
+	std::vector<NetworkNode>::iterator itNode = aNodes.begin();
+	for (; itNode != aNodes.end(); ++itNode)
+	{
+		NetworkNode& node = *itNode;
 
-				FnKat::StringAttribute connItemAttr = connectionsAttr.getChildByIndex(j);
+		if (!node.connections.isValid())
+			continue;
 
-				if (connItemAttr.isValid() && connItemAttr.getValue("", false).find('@') != std::string::npos)
-				{
-					std::string connectedItem = connItemAttr.getValue("", false);
+		unsigned int numConnections = node.connections.getNumberOfChildren();
+		for (unsigned int j = 0; j < numConnections; j++)
+		{
+			std::string paramName = node.connections.getChildName(j);
 
-					size_t atPos = connectedItem.find('@');
+			FnKat::StringAttribute connItemAttr = node.connections.getChildByIndex(j);
+			std::string connectedItem = connItemAttr.isValid() ? connItemAttr.getValue("", false) : "";
 
-					std::string portName = connectedItem.substr(0, atPos);
-					std::string connectionNodeName = connectedItem.substr(atPos + 1);
+			size_t atPos = connectedItem.find('@');
+			if (atPos == std::string::npos)
+			{
+				m_logger.error("Invalid connection item...");
+				continue;
+			}
 
-					bool foundConnection = false;
+			std::string connectionNodeName = connectedItem.substr(atPos + 1);
 
-					// now find what it's connected to
+			std::map<std::string, unsigned int>::const_iterator itFind = aNodeIndices.find(connectionNodeName);
+			if (itFind == aNodeIndices.end())
+			{
+				m_logger.error("Can't find existing Node: %s for connection: %s", connectionNodeName.c_str(), paramName.c_str());
+				continue;
+			}
 
-					// first see if it's an op
-					std::map<std::string, Texture*>::const_iterator itFindItem = aOpNodes.find(connectionNodeName);
-					if (itFindItem != aOpNodes.end())
-					{
-						const Texture* pConn = itFindItem->second;
-						connectTextureToMaterial(pMaterial, shaderName, paramName, pConn);
-						continue;
-					}
+			node.inputs.push_back(NetworkConnection(paramName, (*itFind).second));
+		}
+	}
 
-					// otherwise, see if it was a texture
-					itFindItem = aTextureNodes.find(connectionNodeName);
-					if (itFindItem != aTextureNodes.end())
-					{
-						const Texture* pConn = itFindItem->second;
-						connectTextureToMaterial(pMaterial, shaderName, paramName, pConn);
-						continue;
-					}
+	return !aNodes.empty();
+}
 
-					// otherwise, we didn't find it..
-					m_logger.error("Can't find existing Node: %s for connection: %s", connectionNodeName.c_str(), paramName.c_str());
-					continue;
-				}
-				else
-				{
-					m_logger.error("Invalid connection item...");
-				}
-			}
-		}
-		else
-		{
-			// We're connecting something (hopefully another Texture Op) into this texture op
-			Texture* pTargetTexture = aOpNodes[nodeName];
+bool MaterialHelper::sortNetworkNodes(const std::vector<NetworkNode>& aNodes, unsigned int nodeIndex, std::vector<unsigned char>& aVisitState,
+									  std::vector<unsigned int>& aSortedNodes)
+{
+	// 0 = not visited, 1 = in progress, 2 = done
+	if (aVisitState[nodeIndex] == 2)
+		return true;
 
-			// we're connecting a Texture Op into this shader as an input
-			std::string opName = nodeType.substr(3);
+	if (aVisitState[nodeIndex] == 1)
+		return false;
 
-			for (unsigned int j = 0; j < numConnections; j++)
-			{
-				std::string paramName = connectionsAttr.getChildName(j);
+	aVisitState[nodeIndex] = 1;
 
-				FnKat::StringAttribute connItemAttr = connectionsAttr.getChildByIndex(j);
+	const NetworkNode& node = aNodes[nodeIndex];
+	std::vector<NetworkConnection>::const_iterator itInput = node.inputs.begin();
+	for (; itInput != node.inputs.end(); ++itInput)
+	{
+		if (!sortNetworkNodes(aNodes, (*itInput).sourceNodeIndex, aVisitState, aSortedNodes))
+			return false;
+	}
 
-				if (connItemAttr.isValid() && connItemAttr.getValue("", false).find('@') != std::string::npos)
-				{
-					std::string connectedItem = connItemAttr.getValue("", false);
+	aVisitState[nodeIndex] = 2;
+	aSortedNodes.push_back(nodeIndex);
 
-					size_t atPos = connectedItem.find('@');
+	return true;
+}
 
-					std::string portName = connectedItem.substr(0, atPos);
-					std::string connectionNodeName = connectedItem.substr(atPos + 1);
+const MaterialHelper::NetworkNode* MaterialHelper::findNetworkNodeInput(const std::vector<NetworkNode>& aNodes, const NetworkNode& node,
+																		const std::string& paramName)
+{
+	std::vector<NetworkConnection>::const_iterator itInput = node.inputs.begin();
+	for (; itInput != node.inputs.end(); ++itInput)
+	{
+		if ((*itInput).paramName == paramName)
+			return &aNodes[(*itInput).sourceNodeIndex];
+	}
 
-					// now find what it's connected to
-					// for the moment, hopefully we're only going to be connecting Ops (Textures)
+	return NULL;
+}
 
-					std::map<std::string, Texture*>::const_iterator itFindItem = aOpNodes.find(connectionNodeName);
-					// otherwise, see if it was a texture
-					if (itFindItem == aOpNodes.end())
-					{
-						itFindItem = aTextureNodes.find(connectionNodeName);
-					}
+const Texture* MaterialHelper::getNetworkNodeTexture(NetworkNode& node)
+{
+	// constants that couldn't be folded into their consumer need an actual Texture...
+	if (!node.pTexture && node.isConstant)
+	{
+		Constant* pConstant = new Constant();
+		pConstant->setColour(node.constantColour);
+		node.pTexture = pConstant;
+	}
 
-					if (itFindItem == aOpNodes.end() || itFindItem == aTextureNodes.end())
-					{
-						m_logger.error("Can't find existing Node: %s for connection: %s", connectionNodeName.c_str(), paramName.c_str());
-						continue;
-					}
+	return node.pTexture;
+}
 
-					const Texture* pConn = itFindItem->second;
+bool MaterialHelper::setMaterialConstantColour(Material* pMaterial, const std::string& shaderName, const std::string& paramName, const Colour3f& colour)
+{
+	if (shaderName == "Standard" || shaderName == "StandardImage")
+	{
+		StandardMaterial* pSM = static_cast<StandardMaterial*>(pMaterial);
 
-					connectOpToOp(pTargetTexture, opName, paramName, pConn);
-				}
-				else
-				{
-					m_logger.error("Invalid connection item...");
-				}
-			}
+		if (paramName == "diff_col")
+		{
+			pSM->setDiffuseColour(colour);
+			return true;
+		}
+		else if (paramName == "spec_col")
+		{
+			pSM->setSpecularColour(colour);
+			return true;
 		}
 	}
 
-	// now go through terminals connecting them up...
-	// for the moment, we can just do surface ones...
-
-	return pNewNodeMaterial;
+	return false;
 }
 
 // TODO: these are increadibly hacky - this sort of infrastructure should be moved into Imagine properly and be
@@ -612,53 +985,61 @@ Material* MaterialHelper::createStandardMaterial(const FnKat::GroupAttribute& sh
 {
 	StandardMaterial* pNewStandardMaterial = new StandardMaterial();
 
+	applyStandardMaterialParams(pNewStandardMaterial, shaderParamsAttr, bumpParamsAttr, alphaParamsAttr, true);
+
+	return pNewStandardMaterial;
+}
+
+void MaterialHelper::applyStandardMaterialParams(StandardMaterial* pMaterial, const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr,
+														 FnKat::GroupAttribute& alphaParamsAttr, bool setTextures)
+{
 	KatanaAttributeHelper ah(shaderParamsAttr);
 
 	Colour3f diffColour = ah.getColourParam("diff_col", Colour3f(0.6f, 0.6f, 0.6f));
-	pNewStandardMaterial->setDiffuseColour(diffColour);
+	pMaterial->setDiffuseColour(diffColour);
 
 	// diffuse texture overrides colour if available
 	std::string diffColTexture = ah.getStringParam("diff_col_texture");
-	if (!diffColTexture.empty())
+	if (setTextures && !diffColTexture.empty())
 	{
-		pNewStandardMaterial->setDiffuseTextureMapPath(diffColTexture, true); // lazy load texture when needed
+		pMaterial->setDiffuseTextureMapPath(TextureRegistry::instance().registerTexture(diffColTexture, "diff_col_texture"), true); // lazy load texture when needed
 	}
 
 	float diffRoughness = ah.getFloatParam("diff_roughness", 0.0f);
-	pNewStandardMaterial->setDiffuseRoughness(diffRoughness);
+	pMaterial->setDiffuseRoughness(diffRoughness);
 
 	std::string diffRoughnessTexture = ah.getStringParam("diff_roughness_texture");
-	if (!diffRoughnessTexture.empty())
+	if (setTextures && !diffRoughnessTexture.empty())
 	{
-		pNewStandardMaterial->setDiffuseRoughnessTextureMapPath(diffRoughnessTexture, true);
+		pMaterial->setDiffuseRoughnessTextureMapPath(TextureRegistry::instance().registerTexture(diffRoughnessTexture, "diff_roughness_texture"), true);
 	}
 
 	float diffBacklit = ah.getFloatParam("diff_backlit", 0.0f);
-	pNewStandardMaterial->setDiffuseBacklit(diffBacklit);
+	pMaterial->setDiffuseBacklit(diffBacklit);
 
 	std::string diffBacklitTexture = ah.getStringParam("diff_backlit_texture");
-	if (!diffBacklitTexture.empty())
+	if (setTextures && !diffBacklitTexture.empty())
 	{
-		pNewStandardMaterial->setDiffuseBacklitTextureMapPath(diffBacklitTexture, true);
+		pMaterial->setDiffuseBacklitTextureMapPath(TextureRegistry::instance().registerTexture(diffBacklitTexture, "diff_backlit_texture"), true);
 	}
 
 	Colour3f specColour = ah.getColourParam("spec_col", Colour3f(0.0f, 0.0f, 0.0f));
-	pNewStandardMaterial->setSpecularColour(specColour);
+	pMaterial->setSpecularColour(specColour);
 
 	// specular texture overrides colour if available
 	std::string specTexture = ah.getStringParam("spec_col_texture");
-	if (!specTexture.empty())
+	if (setTextures && !specTexture.empty())
 	{
-		pNewStandardMaterial->setSpecularTextureMapPath(specTexture, true); // lazy load texture when needed
+		pMaterial->setSpecularTextureMapPath(TextureRegistry::instance().registerTexture(specTexture, "spec_col_texture"), true); // lazy load texture when needed
 	}
 
 	float specRoughness = ah.getFloatParam("spec_roughness", 0.15f);
-	pNewStandardMaterial->setSpecularRoughness(specRoughness);
+	pMaterial->setSpecularRoughness(specRoughness);
 
 	std::string specRoughnessTexture = ah.getStringParam("spec_roughness_texture");
-	if (!specRoughnessTexture.empty())
+	if (setTextures && !specRoughnessTexture.empty())
 	{
-		pNewStandardMaterial->setSpecularRoughnessTextureMapPath(specRoughnessTexture, true);
+		pMaterial->setSpecularRoughnessTextureMapPath(TextureRegistry::instance().registerTexture(specRoughnessTexture, "spec_roughness_texture"), true);
 	}
 
 	std::string microfacetType = ah.getStringParam("microfacet_type", "beckmann");
@@ -670,57 +1051,54 @@ Material* MaterialHelper::createStandardMaterial(const FnKat::GroupAttribute& sh
 	else if (microfacetType == "ggx")
 		specType = 3;
 
-	pNewStandardMaterial->setSpecularType(specType);
+	pMaterial->setSpecularType(specType);
 
 	float reflection = ah.getFloatParam("reflection", 0.0f);
-	pNewStandardMaterial->setReflection(reflection);
+	pMaterial->setReflection(reflection);
 
 	float reflectionRoughness = ah.getFloatParam("reflection_roughness", 0.0f);
-	pNewStandardMaterial->setReflectionRoughness(reflectionRoughness);
+	pMaterial->setReflectionRoughness(reflectionRoughness);
 
 	float refractionIndex = ah.getFloatParam("refraction_index", 1.49f);
 
 	int fresnelEnabled = ah.getIntParam("fresnel", 1);
 	if (fresnelEnabled == 1)
 	{
-		pNewStandardMaterial->setFresnelEnabled(true);
+		pMaterial->setFresnelEnabled(true);
 
 		float fresnelCoefficient = ah.getFloatParam("fresnel_coef", 0.0f);
-		pNewStandardMaterial->setFresnelCoefficient(fresnelCoefficient);
+		pMaterial->setFresnelCoefficient(fresnelCoefficient);
 
 		if (refractionIndex == 1.0f)
 			refractionIndex = 1.4f;
 	}
 	else
 	{
-		pNewStandardMaterial->setFresnelEnabled(false);
+		pMaterial->setFresnelEnabled(false);
 	}
 
-	pNewStandardMaterial->setRefractionIndex(refractionIndex);
+	pMaterial->setRefractionIndex(refractionIndex);
 
 	float transparency = ah.getFloatParam("transparency", 0.0f);
-	pNewStandardMaterial->setTransparancy(transparency);
+	pMaterial->setTransparancy(transparency);
 	
 	float transmittance = ah.getFloatParam("transmittance", 1.0f);
-	pNewStandardMaterial->setTransmittance(transmittance);
+	pMaterial->setTransmittance(transmittance);
 
 	int doubleSided = ah.getIntParam("double_sided", 0);
-	if (doubleSided == 1)
-	{
-		pNewStandardMaterial->setDoubleSided(true);
-	}
+	pMaterial->setDoubleSided(doubleSided == 1);
 
 	if (bumpParamsAttr.isValid())
 	{
 		KatanaAttributeHelper ahBump(bumpParamsAttr);
 
 		std::string bumpTexture = ahBump.getStringParam("bump_texture_path");
-		if (!bumpTexture.empty())
+		if (setTextures && !bumpTexture.empty())
 		{
-			pNewStandardMaterial->setBumpTextureMapPath(bumpTexture, true);
+			pMaterial->setBumpTextureMapPath(TextureRegistry::instance().registerTexture(bumpTexture, "bump_texture_path"), true);
 
 			float bumpIntensity = ahBump.getFloatParam("bump_texture_intensity", 0.8f);
-			pNewStandardMaterial->setBumpIntensity(bumpIntensity);
+			pMaterial->setBumpIntensity(bumpIntensity);
 		}
 	}
 
@@ -729,69 +1107,79 @@ Material* MaterialHelper::createStandardMaterial(const FnKat::GroupAttribute& sh
 		KatanaAttributeHelper ahAlpha(alphaParamsAttr);
 
 		std::string alphaTexture = ahAlpha.getStringParam("alpha_texture_path");
-		if (!alphaTexture.empty())
+		if (setTextures && !alphaTexture.empty())
 		{
-			pNewStandardMaterial->setAlphaTextureMapPath(alphaTexture, true);
+			pMaterial->setAlphaTextureMapPath(TextureRegistry::instance().registerTexture(alphaTexture, "alpha_texture_path"), true);
 
 			int invertTexture = ahAlpha.getIntParam("alpha_texture_invert", 0);
 			if (invertTexture == 1)
 			{
-				pNewStandardMaterial->setAlphaTextureInvert(true);
+				pMaterial->setAlphaTextureInvert(true);
 			}
 		}
 	}
-
-	return pNewStandardMaterial;
 }
 
 Material* MaterialHelper::createGlassMaterial(const FnKat::GroupAttribute& shaderParamsAttr)
 {
 	GlassMaterial* pNewMaterial = new GlassMaterial();
 
+	applyGlassMaterialParams(pNewMaterial, shaderParamsAttr, true);
+
+	return pNewMaterial;
+}
+
+void MaterialHelper::applyGlassMaterialParams(GlassMaterial* pMaterial, const FnKat::GroupAttribute& shaderParamsAttr, bool setTextures)
+{
 	KatanaAttributeHelper ah(shaderParamsAttr);
 
 	Colour3f colour = ah.getColourParam("colour", Colour3f(0.0f, 0.0f, 0.0f));
-	pNewMaterial->setColour(colour);
+	pMaterial->setColour(colour);
 
 	float reflection = ah.getFloatParam("reflection", 1.0f);
-	pNewMaterial->setReflection(reflection);
+	pMaterial->setReflection(reflection);
 	float roughness = ah.getFloatParam("roughness", 0.0f);
-	pNewMaterial->setRoughness(roughness);
+	pMaterial->setRoughness(roughness);
 	float transparency = ah.getFloatParam("transparency", 1.0f);
-	pNewMaterial->setTransparency(transparency);
+	pMaterial->setTransparency(transparency);
 	float transmittance = ah.getFloatParam("transmittance", 1.0f);
-	pNewMaterial->setTransmittance(transmittance);
+	pMaterial->setTransmittance(transmittance);
 
 	float refractionIndex = ah.getFloatParam("refraction_index", 1.517f);
-	pNewMaterial->setRefractionIndex(refractionIndex);
+	pMaterial->setRefractionIndex(refractionIndex);
 
 	int fresnel = ah.getIntParam("fresnel", 1);
-	pNewMaterial->setFresnel((bool)fresnel);
+	pMaterial->setFresnel((bool)fresnel);
 
 	int ignoreRefraction = ah.getIntParam("ignore_trans_refraction", 0);
-	pNewMaterial->setIgnoreTransmissionRefraction((bool)ignoreRefraction);
+	pMaterial->setIgnoreTransmissionRefraction((bool)ignoreRefraction);
 
 	int thinVolume = ah.getIntParam("thin_volume", 0);
-	pNewMaterial->setThinVolume((bool)thinVolume);
-
-	return pNewMaterial;
+	pMaterial->setThinVolume((bool)thinVolume);
 }
 
 Material* MaterialHelper::createMetalMaterial(const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr)
 {
 	MetalMaterial* pNewMaterial = new MetalMaterial();
 
+	applyMetalMaterialParams(pNewMaterial, shaderParamsAttr, bumpParamsAttr, true);
+
+	return pNewMaterial;
+}
+
+void MaterialHelper::applyMetalMaterialParams(MetalMaterial* pMaterial, const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr, bool setTextures)
+{
 	KatanaAttributeHelper ah(shaderParamsAttr);
 
 	Colour3f colour = ah.getColourParam("colour", Colour3f(0.9f, 0.9f, 0.9f));
-	pNewMaterial->setColour(colour);
+	pMaterial->setColour(colour);
 
 	float refractionIndex = ah.getFloatParam("refraction_index", 1.39f);
-	pNewMaterial->setRefractionIndex(refractionIndex);
+	pMaterial->setRefractionIndex(refractionIndex);
 	float k = ah.getFloatParam("k", 4.8f);
-	pNewMaterial->setK(k);
+	pMaterial->setK(k);
 	float roughness = ah.getFloatParam("roughness", 0.01f);
-	pNewMaterial->setRoughness(roughness);
+	pMaterial->setRoughness(roughness);
 
 	std::string microfacetType = ah.getStringParam("microfacet_type", "beckmann");
 	int microfacetModel = 1;
@@ -802,305 +1190,323 @@ Material* MaterialHelper::createMetalMaterial(const FnKat::GroupAttribute& shade
 	else if (microfacetType == "ggx")
 		microfacetModel = 2;
 
-	pNewMaterial->setMicrofacetModel(microfacetModel);
+	pMaterial->setMicrofacetModel(microfacetModel);
 
 	int doubleSided = ah.getIntParam("double_sided", 0);
-	if (doubleSided == 1)
-	{
-		pNewMaterial->setDoubleSided(true);
-	}
+	pMaterial->setDoubleSided(doubleSided == 1);
 
 	if (bumpParamsAttr.isValid())
 	{
 		KatanaAttributeHelper ahBump(bumpParamsAttr);
 
 		std::string bumpTexture = ahBump.getStringParam("bump_texture_path");
-		if (!bumpTexture.empty())
+		if (setTextures && !bumpTexture.empty())
 		{
-			pNewMaterial->setBumpTextureMapPath(bumpTexture, true);
+			pMaterial->setBumpTextureMapPath(TextureRegistry::instance().registerTexture(bumpTexture, "bump_texture_path"), true);
 
 			float bumpIntensity = ahBump.getFloatParam("bump_texture_intensity", 0.8f);
-			pNewMaterial->setBumpIntensity(bumpIntensity);
+			pMaterial->setBumpIntensity(bumpIntensity);
 		}
 	}
-
-	return pNewMaterial;
 }
 
 Material* MaterialHelper::createPlasticMaterial(const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr)
 {
 	PlasticMaterial* pNewMaterial = new PlasticMaterial();
 
+	applyPlasticMaterialParams(pNewMaterial, shaderParamsAttr, bumpParamsAttr, true);
+
+	return pNewMaterial;
+}
+
+void MaterialHelper::applyPlasticMaterialParams(PlasticMaterial* pMaterial, const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr, bool setTextures)
+{
 	KatanaAttributeHelper ah(shaderParamsAttr);
 
 	Colour3f colour = ah.getColourParam("colour", Colour3f(0.5f, 0.5f, 1.0f));
-	pNewMaterial->setColour(colour);
+	pMaterial->setColour(colour);
 
 	float refractionIndex = ah.getFloatParam("refraction_index", 1.39f);
-	pNewMaterial->setRefractionIndex(refractionIndex);
+	pMaterial->setRefractionIndex(refractionIndex);
 
 	float roughness = ah.getFloatParam("roughness", 0.01f);
-	pNewMaterial->setRoughness(roughness);
+	pMaterial->setRoughness(roughness);
 
 	float fresnelCoefficient = ah.getFloatParam("fresnel_coef", 0.0f);
-	pNewMaterial->setFresnelCoefficient(fresnelCoefficient);
+	pMaterial->setFresnelCoefficient(fresnelCoefficient);
 /*
 	if (bumpParamsAttr.isValid())
 	{
 		KatanaAttributeHelper ahBump(bumpParamsAttr);
 
 		std::string bumpTexture = ahBump.getStringParam("bump_texture_path");
-		if (!bumpTexture.empty())
+		if (setTextures && !bumpTexture.empty())
 		{
-			pNewMaterial->setBumpTextureMapPath(bumpTexture, true);
+			pMaterial->setBumpTextureMapPath(TextureRegistry::instance().registerTexture(bumpTexture, "bump_texture_path"), true);
 
 			float bumpIntensity = ahBump.getFloatParam("bump_texture_intensity", 0.8f);
-			pNewMaterial->setBumpIntensity(bumpIntensity);
+			pMaterial->setBumpIntensity(bumpIntensity);
 		}
 	}
 */
-	return pNewMaterial;
 }
 
 Material* MaterialHelper::createBrushedMetalMaterial(const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr)
 {
 	BrushedMetalMaterial* pNewMaterial = new BrushedMetalMaterial();
 
+	applyBrushedMetalMaterialParams(pNewMaterial, shaderParamsAttr, bumpParamsAttr, true);
+
+	return pNewMaterial;
+}
+
+void MaterialHelper::applyBrushedMetalMaterialParams(BrushedMetalMaterial* pMaterial, const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr, bool setTextures)
+{
 	KatanaAttributeHelper ah(shaderParamsAttr);
 
 	Colour3f colour = ah.getColourParam("colour", Colour3f(0.9f, 0.9f, 0.9f));
-	pNewMaterial->setColour(colour);
+	pMaterial->setColour(colour);
 
 	float refractionIndex = ah.getFloatParam("refraction_index", 1.39f);
-	pNewMaterial->setRefractionIndex(refractionIndex);
+	pMaterial->setRefractionIndex(refractionIndex);
 	float k = ah.getFloatParam("k", 4.8f);
-	pNewMaterial->setK(k);
+	pMaterial->setK(k);
 	float roughnessX = ah.getFloatParam("roughness_x", 0.1f);
-	pNewMaterial->setRoughnessX(roughnessX);
+	pMaterial->setRoughnessX(roughnessX);
 	float roughnessY = ah.getFloatParam("roughness_y", 0.02f);
-	pNewMaterial->setRoughnessY(roughnessY);
+	pMaterial->setRoughnessY(roughnessY);
 
 	int doubleSided = ah.getIntParam("double_sided", 0);
-	if (doubleSided == 1)
-	{
-		pNewMaterial->setDoubleSided(true);
-	}
+	pMaterial->setDoubleSided(doubleSided == 1);
 
 	if (bumpParamsAttr.isValid())
 	{
 		KatanaAttributeHelper ahBump(bumpParamsAttr);
 
 		std::string bumpTexture = ahBump.getStringParam("bump_texture_path");
-		if (!bumpTexture.empty())
+		if (setTextures && !bumpTexture.empty())
 		{
-			pNewMaterial->setBumpTextureMapPath(bumpTexture, true);
+			pMaterial->setBumpTextureMapPath(TextureRegistry::instance().registerTexture(bumpTexture, "bump_texture_path"), true);
 
 			float bumpIntensity = ahBump.getFloatParam("bump_texture_intensity", 0.8f);
-			pNewMaterial->setBumpIntensity(bumpIntensity);
+			pMaterial->setBumpIntensity(bumpIntensity);
 		}
 	}
-
-	return pNewMaterial;
 }
 
 Material* MaterialHelper::createMetallicPaintMaterial(const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr)
 {
 	MetallicPaintMaterial* pNewMaterial = new MetallicPaintMaterial();
 
+	applyMetallicPaintMaterialParams(pNewMaterial, shaderParamsAttr, bumpParamsAttr, true);
+
+	return pNewMaterial;
+}
+
+void MaterialHelper::applyMetallicPaintMaterialParams(MetallicPaintMaterial* pMaterial, const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr, bool setTextures)
+{
 	KatanaAttributeHelper ah(shaderParamsAttr);
 
 	Colour3f colour = ah.getColourParam("colour", Colour3f(0.29f, 0.016f, 0.019f));
-	pNewMaterial->setColour(colour);
+	pMaterial->setColour(colour);
 
 	std::string colourTexture = ah.getStringParam("col_texture");
-	if (!colourTexture.empty())
+	if (setTextures && !colourTexture.empty())
 	{
-		pNewMaterial->setColourTexture(colourTexture, true); // lazy load texture when needed
+		pMaterial->setColourTexture(TextureRegistry::instance().registerTexture(colourTexture, "col_texture"), true); // lazy load texture when needed
 	}
 
 	Colour3f flakeColour = ah.getColourParam("flake_colour", Colour3f(0.39, 0.016f, 0.19f));
-	pNewMaterial->setFlakeColour(flakeColour);
+	pMaterial->setFlakeColour(flakeColour);
 
 	float flakeSpread = ah.getFloatParam("flake_spread", 0.32f);
-	pNewMaterial->setFlakeSpread(flakeSpread);
+	pMaterial->setFlakeSpread(flakeSpread);
 
 	float flakeMix = ah.getFloatParam("flake_mix", 0.38f);
-	pNewMaterial->setFlakeMix(flakeMix);
+	pMaterial->setFlakeMix(flakeMix);
 
 	float refractionIndex = ah.getFloatParam("refraction_index", 1.39f);
-	pNewMaterial->setRefractionIndex(refractionIndex);
+	pMaterial->setRefractionIndex(refractionIndex);
 
 	float reflection = ah.getFloatParam("reflection", 1.0f);
-	pNewMaterial->setReflection(reflection);
+	pMaterial->setReflection(reflection);
 
 	float fresnelCoefficient = ah.getFloatParam("fresnel_coef", 0.0f);
-	pNewMaterial->setFresnelCoefficient(fresnelCoefficient);
+	pMaterial->setFresnelCoefficient(fresnelCoefficient);
 
 	if (bumpParamsAttr.isValid())
 	{
 		KatanaAttributeHelper ahBump(bumpParamsAttr);
 
 		std::string bumpTexture = ahBump.getStringParam("bump_texture_path");
-		if (!bumpTexture.empty())
+		if (setTextures && !bumpTexture.empty())
 		{
-			pNewMaterial->setBumpTextureMapPath(bumpTexture, true);
+			pMaterial->setBumpTextureMapPath(TextureRegistry::instance().registerTexture(bumpTexture, "bump_texture_path"), true);
 
 			float bumpIntensity = ahBump.getFloatParam("bump_texture_intensity", 0.8f);
-			pNewMaterial->setBumpIntensity(bumpIntensity);
+			pMaterial->setBumpIntensity(bumpIntensity);
 		}
 	}
-
-	return pNewMaterial;
 }
 
 Material* MaterialHelper::createTranslucentMaterial(const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr)
 {
 	TranslucentMaterial* pNewMaterial = new TranslucentMaterial();
 
+	applyTranslucentMaterialParams(pNewMaterial, shaderParamsAttr, bumpParamsAttr, true);
+
+	return pNewMaterial;
+}
+
+void MaterialHelper::applyTranslucentMaterialParams(TranslucentMaterial* pMaterial, const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr, bool setTextures)
+{
 	KatanaAttributeHelper ah(shaderParamsAttr);
 
 	Colour3f surfaceColour = ah.getColourParam("surface_col", Colour3f(0.0f, 0.0f, 0.0f));
-	pNewMaterial->setSurfaceColour(surfaceColour);
+	pMaterial->setSurfaceColour(surfaceColour);
 
 	std::string surfaceColourTexture = ah.getStringParam("surface_col_texture");
-	if (!surfaceColourTexture.empty())
+	if (setTextures && !surfaceColourTexture.empty())
 	{
-		pNewMaterial->setSurfaceColourTextureMapPath(surfaceColourTexture, true); // lazy load texture when needed
+		pMaterial->setSurfaceColourTextureMapPath(TextureRegistry::instance().registerTexture(surfaceColourTexture, "surface_col_texture"), true); // lazy load texture when needed
 	}
 
 	Colour3f specularColour = ah.getColourParam("specular_col", Colour3f(0.1f, 0.1f, 0.1f));
-	pNewMaterial->setSpecularColour(specularColour);
+	pMaterial->setSpecularColour(specularColour);
 
 	std::string specularColourTexture = ah.getStringParam("specular_col_texture");
-	if (!specularColourTexture.empty())
+	if (setTextures && !specularColourTexture.empty())
 	{
-		pNewMaterial->setSpecularColourTextureMapPath(specularColourTexture, true); // lazy load texture when needed
+		pMaterial->setSpecularColourTextureMapPath(TextureRegistry::instance().registerTexture(specularColourTexture, "specular_col_texture"), true); // lazy load texture when needed
 	}
 
 	float surfaceRoughness = ah.getFloatParam("specular_roughness", 0.05f);
-	pNewMaterial->setSpecularRoughness(surfaceRoughness);
+	pMaterial->setSpecularRoughness(surfaceRoughness);
 
 	std::string surfaceType = ah.getStringParam("surface_type", "diffuse");
 	if (surfaceType == "diffuse")
 	{
-		pNewMaterial->setSurfaceType(0);
+		pMaterial->setSurfaceType(0);
 	}
 	else if (surfaceType == "dielectric layer")
 	{
-		pNewMaterial->setSurfaceType(1);
+		pMaterial->setSurfaceType(1);
 	}
 	else if (surfaceType == "transmission only")
 	{
-		pNewMaterial->setSurfaceType(2);
+		pMaterial->setSurfaceType(2);
 	}
 
 	std::string scatterMode = ah.getStringParam("scatter_mode", "mean free path");
 	if (scatterMode == "legacy")
 	{
-		pNewMaterial->setScatteringMode(0);
+		pMaterial->setScatteringMode(0);
 
 		Colour3f innerColour = ah.getColourParam("inner_col", Colour3f(0.4f, 0.4f, 0.4f));
-		pNewMaterial->setInnerColour(innerColour);
+		pMaterial->setInnerColour(innerColour);
 
 		float subsurfaceDensity = ah.getFloatParam("subsurface_density", 3.1f);
-		pNewMaterial->setSubsurfaceDensity(subsurfaceDensity);
+		pMaterial->setSubsurfaceDensity(subsurfaceDensity);
 	}
 	else
 	{
-		pNewMaterial->setScatteringMode(1);
+		pMaterial->setScatteringMode(1);
 
 		Colour3f mfp = ah.getColourParam("mfp", Colour3f(0.22f, 0.081f, 0.06f));
-		pNewMaterial->setMeanFreePath(mfp);
+		pMaterial->setMeanFreePath(mfp);
 
 		float mfpScale = ah.getFloatParam("mfp_scale", 2.7f);
-		pNewMaterial->setMeanFreePathScale(mfpScale);
+		pMaterial->setMeanFreePathScale(mfpScale);
 
 		Colour3f scatterAlbedo = ah.getColourParam("scatter_albedo", Colour3f(0.3f));
-		pNewMaterial->setScatterAlbedo(scatterAlbedo);
+		pMaterial->setScatterAlbedo(scatterAlbedo);
 	}
 
 	float samplingSensity = ah.getFloatParam("sampling_density", 0.65f);
-	pNewMaterial->setSamplingDensity(samplingSensity);
+	pMaterial->setSamplingDensity(samplingSensity);
 
 	unsigned int scatterLimit = ah.getIntParam("scatter_limit", 6);
-	pNewMaterial->setScatterLimit(scatterLimit);
+	pMaterial->setScatterLimit(scatterLimit);
 
 	float transmittance = ah.getFloatParam("transmittance", 1.0f);
-	pNewMaterial->setTransmittance(transmittance);
+	pMaterial->setTransmittance(transmittance);
 	float transmittanceRoughness = ah.getFloatParam("transmittance_roughness", 0.8f);
-	pNewMaterial->setTransmittanceRoughness(transmittanceRoughness);
+	pMaterial->setTransmittanceRoughness(transmittanceRoughness);
 
 	bool surfaceColourAsTransmittance = ah.getIntParam("use_surf_col_as_trans", 0) == 1;
-	pNewMaterial->setUseSurfaceColourAsTransmittance(surfaceColourAsTransmittance);
+	pMaterial->setUseSurfaceColourAsTransmittance(surfaceColourAsTransmittance);
 
 	std::string entryExitType = ah.getStringParam("entry_exit_type");
 	if (entryExitType == "refractive fresnel")
 	{
-		pNewMaterial->setEntryExitType(0);
+		pMaterial->setEntryExitType(0);
 	}
 	else if (entryExitType == "refractive")
 	{
-		pNewMaterial->setEntryExitType(1);
+		pMaterial->setEntryExitType(1);
 	}
 	else if (entryExitType == "transmissive")
 	{
-		pNewMaterial->setEntryExitType(2);
+		pMaterial->setEntryExitType(2);
 	}
 
 	float absorption = ah.getFloatParam("absorption_ratio", 0.46f);
-	pNewMaterial->setAbsorptionRatio(absorption);
+	pMaterial->setAbsorptionRatio(absorption);
 
 	float refractionIndex = ah.getFloatParam("refractionIndex", 1.42f);
-	pNewMaterial->setRefractionIndex(refractionIndex);
+	pMaterial->setRefractionIndex(refractionIndex);
 
 	if (bumpParamsAttr.isValid())
 	{
 		KatanaAttributeHelper ahBump(bumpParamsAttr);
 
 		std::string bumpTexture = ahBump.getStringParam("bump_texture_path");
-		if (!bumpTexture.empty())
+		if (setTextures && !bumpTexture.empty())
 		{
-			pNewMaterial->setBumpTextureMapPath(bumpTexture, true);
+			pMaterial->setBumpTextureMapPath(TextureRegistry::instance().registerTexture(bumpTexture, "bump_texture_path"), true);
 
 			float bumpIntensity = ahBump.getFloatParam("bump_texture_intensity", 0.8f);
-			pNewMaterial->setBumpIntensity(bumpIntensity);
+			pMaterial->setBumpIntensity(bumpIntensity);
 		}
 	}
-
-	return pNewMaterial;
 }
 
 Material* MaterialHelper::createVelvetMaterial(const FnKat::GroupAttribute& shaderParamsAttr)
 {
 	VelvetMaterial* pNewMaterial = new VelvetMaterial();
 
+	applyVelvetMaterialParams(pNewMaterial, shaderParamsAttr, true);
+
+	return pNewMaterial;
+}
+
+void MaterialHelper::applyVelvetMaterialParams(VelvetMaterial* pMaterial, const FnKat::GroupAttribute& shaderParamsAttr, bool setTextures)
+{
 	KatanaAttributeHelper ah(shaderParamsAttr);
 
 	Colour3f horizonColour = ah.getColourParam("horiz_col", Colour3f(0.7f, 0.7f, 0.7f));
-	pNewMaterial->setHorizonScatteringColour(horizonColour);
+	pMaterial->setHorizonScatteringColour(horizonColour);
 
 	std::string horizonColourTexture = ah.getStringParam("horiz_col_texture");
-	if (!horizonColourTexture.empty())
+	if (setTextures && !horizonColourTexture.empty())
 	{
-		pNewMaterial->setHorizonScatteringColourTexture(horizonColourTexture, true);
+		pMaterial->setHorizonScatteringColourTexture(TextureRegistry::instance().registerTexture(horizonColourTexture, "horiz_col_texture"), true);
 	}
 
 	float horizonScatterFalloff = ah.getFloatParam("horiz_scatter_falloff", 0.4f);
-	pNewMaterial->setHorizonScatteringFalloff(horizonScatterFalloff);
+	pMaterial->setHorizonScatteringFalloff(horizonScatterFalloff);
 
 	Colour3f backscatterColour = ah.getColourParam("backscatter_col", Colour3f(0.4f, 0.4f, 0.4f));
-	pNewMaterial->setBackScatteringColour(backscatterColour);
+	pMaterial->setBackScatteringColour(backscatterColour);
 
 	std::string backscatterColourTexture = ah.getStringParam("backscatter_col_texture");
-	if (!backscatterColourTexture.empty())
+	if (setTextures && !backscatterColourTexture.empty())
 	{
-		pNewMaterial->setBackScatteringColourTexture(backscatterColourTexture, true);
+		pMaterial->setBackScatteringColourTexture(TextureRegistry::instance().registerTexture(backscatterColourTexture, "backscatter_col_texture"), true);
 	}
 
 	float backscatterFalloff = ah.getFloatParam("backscatter", 0.7f);
-	pNewMaterial->setBackScatteringFalloff(backscatterFalloff);
-
-	return pNewMaterial;
+	pMaterial->setBackScatteringFalloff(backscatterFalloff);
 }
 
 Material* MaterialHelper::createLuminousMaterial(const FnKat::GroupAttribute& shaderParamsAttr)
@@ -1220,7 +1626,7 @@ Imagine::Texture* MaterialHelper::createTextureReadTexture(const FnKat::GroupAtt
 	
 	std::string texturePath = ah.getStringParam("texture_path");
 	
-	pNewTexture->setTexturePath(texturePath);
+	pNewTexture->setTexturePath(TextureRegistry::instance().registerTexture(texturePath, "texture_path"));
 	
 	return pNewTexture;
 }
@@ -20,6 +20,7 @@
 #define MATERIAL_HELPER_H
 
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
 
@@ -37,6 +38,15 @@ namespace Imagine
 	class Material;
 	class Texture;
 	class Logger;
+
+	class StandardMaterial;
+	class GlassMaterial;
+	class MetalMaterial;
+	class PlasticMaterial;
+	class BrushedMetalMaterial;
+	class MetallicPaintMaterial;
+	class TranslucentMaterial;
+	class VelvetMaterial;
 }
 
 class MaterialHelper
@@ -46,21 +56,53 @@ public:
 
 	Imagine::Material* getOrCreateMaterialForLocation(const FnKat::FnScenegraphIterator& iterator, const FnKat::GroupAttribute& imagineStatements, bool fallbackToDefault = true);
 
+	// materialRawHash is the hash of the flattened material attribute
+	Imagine::Material* getOrCreateMaterial(const FnKat::GroupAttribute& materialAttrib, uint64_t materialRawHash,
+										   const FnKat::GroupAttribute& imagineStatements, bool fallbackToDefault = true);
+	// as above, but with the matte state given directly rather than from the location's imagineStatements
+	Imagine::Material* getOrCreateMaterial(const FnKat::GroupAttribute& materialAttrib, uint64_t materialRawHash, bool isMatte,
+										   bool fallbackToDefault);
+
 	FnKat::GroupAttribute getMaterialForLocation(const FnKat::FnScenegraphIterator& iterator) const;
 
+	// same as above, but cached based on the location's materialAssign path and any material overrides, so that the
+	// (expensive) flattening is only done once for all locations sharing the same assignment.
+	FnKat::GroupAttribute getMaterialForLocationCached(const FnKat::FnScenegraphIterator& iterator, uint64_t& materialRawHash);
+
 	std::vector<Imagine::Material*>& getMaterialsVector() { return m_aMaterials; }
 
 	Imagine::Material* getDefaultMaterial() { return m_pDefaultMaterial; }
 
+	// A material's "template" is everything about it apart from its scalar and colour parameter values: the shader type,
+	// texture bindings and bump / alpha settings. Materials sharing a template only differ in values which can be
+	// changed in place.
+	static Imagine::HashValue calculateTemplateHash(const FnKat::GroupAttribute& materialAttrib, bool isMatte);
+
+	// returns 0 if the material wasn't created by us
+	Imagine::HashValue getMaterialTemplateHash(const Imagine::Material* pMaterial);
+
+	// whether the material was created for matte objects, so replacement materials can keep the same state
+	bool isMaterialMatte(const Imagine::Material* pMaterial) const;
+
+	// Materials are shared between all objects with the same material values, so these keep track of how many objects
+	// are using each one, so live edits can tell whether patching one in place would affect objects which weren't edited.
+	void addMaterialUser(const Imagine::Material* pMaterial);
+	void removeMaterialUser(const Imagine::Material* pMaterial);
+	unsigned int getMaterialUserCount(const Imagine::Material* pMaterial) const;
+
+	// For live rendering: if the new material attribute has the same template as the existing material, its params
+	// are set on the existing material (leaving its textures alone) and true is returned. All objects using the material
+	// see the change. Otherwise, nothing is changed, and a new material is needed.
+	bool patchMaterial(Imagine::Material* pMaterial, const FnKat::GroupAttribute& materialAttrib, uint64_t materialRawHash);
+
+	void printStatistics() const;
+
 protected:
 
 	// this adds to the instances map itself if materials are created
 	Imagine::Material* createNewMaterial(const FnKat::GroupAttribute& attribute, bool isMatte, bool fallbackToDefault);
 
 public:
-	// hack for live rendering prototyping
-	static Imagine::Material* createNewMaterialStandAlone(const std::string& materialType, const FnKat::GroupAttribute& shaderParamsAttr);
-
 	// called by createNewMaterial to try and create a network material from the attribute...
 	// TODO: all this stuff is pretty horrendous, but while verbose, it's easiest for the moment until we work
 	//       out what we're doing with built-in shaders which use static const init registration (so don't work in .so files),
@@ -68,6 +110,55 @@ public:
 	Imagine::Material* createNetworkMaterial(const FnKat::GroupAttribute& attribute, bool isMatte);
 
 protected:
+	struct NetworkConnection
+	{
+		NetworkConnection(const std::string& param, unsigned int source) : paramName(param), sourceNodeIndex(source)
+		{
+		}
+
+		std::string		paramName;
+		unsigned int	sourceNodeIndex;
+	};
+
+	// compiled representation of a network material node
+	struct NetworkNode
+	{
+		enum Category
+		{
+			eShader,
+			eOp,
+			eTexture
+		};
+
+		NetworkNode() : category(eTexture), pMaterial(NULL), pTexture(NULL), isConstant(false)
+		{
+		}
+
+		std::string						name;
+		Category						category;
+		std::string						typeName; // without the category prefix
+		FnKat::GroupAttribute			params;
+		FnKat::GroupAttribute			connections;
+
+		std::vector<NetworkConnection>	inputs;
+
+		// built items
+		Imagine::Material*				pMaterial;
+		Imagine::Texture*				pTexture;
+
+		// constant-folded value - if set, pTexture is only created if something can't use the constant directly
+		bool							isConstant;
+		Imagine::Colour3f				constantColour;
+	};
+
+	bool compileNetworkNodes(const FnKat::GroupAttribute& nodesAttr, std::vector<NetworkNode>& aNodes);
+	static bool sortNetworkNodes(const std::vector<NetworkNode>& aNodes, unsigned int nodeIndex, std::vector<unsigned char>& aVisitState,
+								 std::vector<unsigned int>& aSortedNodes);
+	static const NetworkNode* findNetworkNodeInput(const std::vector<NetworkNode>& aNodes, const NetworkNode& node, const std::string& paramName);
+	static const Imagine::Texture* getNetworkNodeTexture(NetworkNode& node);
+	static bool setMaterialConstantColour(Imagine::Material* pMaterial, const std::string& shaderName, const std::string& paramName,
+										  const Imagine::Colour3f& colour);
+
 	static Imagine::Texture* createNetworkOpItem(const std::string& opName, const FnKat::GroupAttribute& params);
 	static Imagine::Texture* createNetworkTextureItem(const std::string& textureName, const FnKat::GroupAttribute& params);
 
@@ -87,6 +178,21 @@ protected:
 	static Imagine::Material* createVelvetMaterial(const FnKat::GroupAttribute& shaderParamsAttr);
 	static Imagine::Material* createLuminousMaterial(const FnKat::GroupAttribute& shaderParamsAttr);
 
+	// these set all the params on existing materials, so that the same code can be used for creation and live patching.
+	// Texture paths are only set if setTextures is true.
+	static void applyStandardMaterialParams(Imagine::StandardMaterial* pMaterial, const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr,
+											FnKat::GroupAttribute& alphaParamsAttr, bool setTextures);
+	static void applyGlassMaterialParams(Imagine::GlassMaterial* pMaterial, const FnKat::GroupAttribute& shaderParamsAttr, bool setTextures);
+	static void applyMetalMaterialParams(Imagine::MetalMaterial* pMaterial, const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr, bool setTextures);
+	static void applyPlasticMaterialParams(Imagine::PlasticMaterial* pMaterial, const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr, bool setTextures);
+	static void applyBrushedMetalMaterialParams(Imagine::BrushedMetalMaterial* pMaterial, const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr,
+												bool setTextures);
+	static void applyMetallicPaintMaterialParams(Imagine::MetallicPaintMaterial* pMaterial, const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr,
+												 bool setTextures);
+	static void applyTranslucentMaterialParams(Imagine::TranslucentMaterial* pMaterial, const FnKat::GroupAttribute& shaderParamsAttr, FnKat::GroupAttribute& bumpParamsAttr,
+											   bool setTextures);
+	static void applyVelvetMaterialParams(Imagine::VelvetMaterial* pMaterial, const FnKat::GroupAttribute& shaderParamsAttr, bool setTextures);
+
 	// stuff for textures
 	static Imagine::Texture* createConstantTexture(const FnKat::GroupAttribute& textureParamsAttr);
 	static Imagine::Texture* createCheckerboardTexture(const FnKat::GroupAttribute& textureParamsAttr);
@@ -97,14 +203,33 @@ protected:
 	
 	static bool isRecognisedShaderType(const std::string& name);
 
+protected:
+	struct FlattenedMaterial
+	{
+		FlattenedMaterial() : rawHash(0)
+		{
+		}
+
+		FnKat::GroupAttribute	attribute;
+		uint64_t				rawHash;
+	};
+
 protected:
 	Imagine::Logger&						m_logger;
 	FnKat::StringAttribute					m_terminatorNodes;
 
+	std::map<Imagine::HashValue, FlattenedMaterial>	m_aFlattenedMaterials; // cache of flattened material attributes by assignment
+
 	std::map<Imagine::HashValue, Imagine::Material*>	m_aMaterialInstances; // all materials with hashes
 
 	std::vector<Imagine::Material*>			m_aMaterials; // all material instances in std::vector
 
+	std::map<Imagine::HashValue, unsigned int>					m_aTemplateVariantCounts;
+	std::map<const Imagine::Material*, Imagine::HashValue>		m_aMaterialTemplates;
+	std::set<const Imagine::Material*>							m_aMatteMaterials;
+	// number of objects using each material
+	std::map<const Imagine::Material*, unsigned int>			m_aMaterialUserCounts;
+
 	Imagine::Material*						m_pDefaultMaterial;
 	Imagine::Material*						m_pDefaultMaterialMatte; // annoying, but...
 };
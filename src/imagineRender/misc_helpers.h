@@ -23,9 +23,10 @@ struct CreationSettings
 {
 	CreationSettings() : m_applyMaterials(true), m_useTextures(true), m_enableSubdivision(false), m_deduplicateVertexNormals(false),
 		m_specialiseType(eNone), m_specialisedDetectInstances(true), m_useGeoNormals(true),
-	    m_useBounds(true), m_followRelativeInstanceSources(true), m_motionBlur(false), m_decomposeXForms(false),
+	    m_useBounds(true), m_followRelativeInstanceSources(true), m_motionBlur(false), m_motionBlurMaxSegments(1), m_decomposeXForms(false),
 		m_discardGeometry(false), m_chunkedParallelBuild(false),
-		m_flipT(0), m_triangleType(0), m_geoQuantisationType(0), m_specialisedTriangleType(0), m_shutterOpen(0.0f), m_shutterClose(0.0f)
+		m_flipT(0), m_triangleType(0), m_geoQuantisationType(0), m_specialisedTriangleType(0), m_shutterOpen(0.0f), m_shutterClose(0.0f),
+		m_velocityScale(1.0f / 24.0f)
 	{
 	}
 
@@ -47,6 +48,7 @@ struct CreationSettings
 	bool				m_followRelativeInstanceSources;
 
 	bool				m_motionBlur;
+	unsigned int		m_motionBlurMaxSegments; // caps the number of deformation motion segments (samples - 1)
 	bool				m_decomposeXForms;
 	bool				m_discardGeometry;
 	bool				m_chunkedParallelBuild;
@@ -58,6 +60,8 @@ struct CreationSettings
 
 	float				m_shutterOpen;
 	float				m_shutterClose;
+
+	float				m_velocityScale; // multiplier to convert geometry.point.v (per second) to units per frame - 0.0 disables velocity blur
 };
 
 #endif // MISC_HELPERS_H
@@ -69,6 +69,24 @@ bool ImagineRender::configureRenderSettings(Foundry::Katana::Render::RenderSetti
 		m_fastLiveRenders = (fastLiveRendersAttribute.getValue(0, false) == 1);
 	}
 
+	FnKat::IntAttribute incrementalLiveRestartsAttribute = imagineGSAttribute.getChildByName("incremental_live_restarts");
+	if (incrementalLiveRestartsAttribute.isValid())
+	{
+		m_incrementalLiveRestarts = (incrementalLiveRestartsAttribute.getValue(0, false) == 1);
+	}
+
+	FnKat::IntAttribute liveProgressiveResolutionAttribute = imagineGSAttribute.getChildByName("live_progressive_resolution");
+	if (liveProgressiveResolutionAttribute.isValid())
+	{
+		m_liveProgressiveResolution = (liveProgressiveResolutionAttribute.getValue(0, false) == 1);
+	}
+
+	FnKat::IntAttribute liveFoveatedRenderingAttribute = imagineGSAttribute.getChildByName("live_foveated_rendering");
+	if (liveFoveatedRenderingAttribute.isValid())
+	{
+		m_liveFoveatedRendering = (liveFoveatedRenderingAttribute.getValue(0, false) == 1);
+	}
+
 	unsigned int filterType = gsHelper.getIntParam("reconstruction_filter", 3);
 	float filterScale = gsHelper.getFloatParam("filter_scale", 1.0f);
 
@@ -132,6 +150,32 @@ bool ImagineRender::configureRenderSettings(Foundry::Katana::Render::RenderSetti
 	m_creationSettings.m_motionBlur = (motionBlur == 1);
 	m_renderSettings.add("motionBlur", m_creationSettings.m_motionBlur); // needs to be bool
 
+	FnKat::IntAttribute motionBlurMaxSegmentsAttribute = imagineGSAttribute.getChildByName("motion_blur_max_segments");
+	if (motionBlurMaxSegmentsAttribute.isValid())
+	{
+		int maxSegments = motionBlurMaxSegmentsAttribute.getValue(1, false);
+		m_creationSettings.m_motionBlurMaxSegments = (maxSegments < 1) ? 1 : (unsigned int)maxSegments;
+	}
+
+	// velocities are per second, but shutter times are in frames
+	float velocityScale = 1.0f;
+	FnKat::FloatAttribute velocityScaleAttribute = imagineGSAttribute.getChildByName("velocity_scale");
+	if (velocityScaleAttribute.isValid())
+		velocityScale = velocityScaleAttribute.getValue(1.0f, false);
+
+	float framesPerSecond = 24.0f;
+	FnKat::FloatAttribute framesPerSecondAttribute = imagineGSAttribute.getChildByName("frames_per_second");
+	if (framesPerSecondAttribute.isValid())
+		framesPerSecond = framesPerSecondAttribute.getValue(24.0f, false);
+
+	if (framesPerSecond <= 0.0f)
+	{
+		m_logger.warning("Invalid frames per second value: %f, using 24 instead.", framesPerSecond);
+		framesPerSecond = 24.0f;
+	}
+
+	m_creationSettings.m_velocityScale = velocityScale / framesPerSecond;
+
 	FnKat::IntAttribute flipTAttribute = imagineGSAttribute.getChildByName("flip_t");
 	m_creationSettings.m_flipT = false;
 	if (flipTAttribute.isValid())
@@ -225,6 +269,15 @@ bool ImagineRender::configureRenderSettings(Foundry::Katana::Render::RenderSetti
 	if (printMemoryStatisticsAttribute.isValid())
 		m_printMemoryStatistics = printMemoryStatisticsAttribute.getValue(0, false);
 
+	FnKat::IntAttribute expansionProfilingAttribute = imagineGSAttribute.getChildByName("expansion_profiling");
+	m_expansionProfilingType = 0;
+	if (expansionProfilingAttribute.isValid())
+		m_expansionProfilingType = expansionProfilingAttribute.getValue(0, false);
+
+	FnKat::IntAttribute expansionProfilingTopNAttribute = imagineGSAttribute.getChildByName("expansion_profiling_top_n");
+	if (expansionProfilingTopNAttribute.isValid())
+		m_expansionProfilingTopN = expansionProfilingTopNAttribute.getValue(20, false);
+
 	FnKat::FloatAttribute rayEpsilonAttribute = imagineGSAttribute.getChildByName("ray_epsilon");
 	float rayEpsilon = 0.0001f;
 	if (rayEpsilonAttribute.isValid())
@@ -272,6 +325,10 @@ bool ImagineRender::configureRenderSettings(Foundry::Katana::Render::RenderSetti
 	if (textureCachingType == 0)
 	{
 		GlobalContext::instance().setTextureCachingType(GlobalContext::eTextureCachingNone);
+
+		// no limits to check against
+		m_textureCacheMaxSize = 0;
+		m_textureCacheMaxFileHandles = 0;
 	}
 	else
 	{
@@ -288,9 +345,32 @@ bool ImagineRender::configureRenderSettings(Foundry::Katana::Render::RenderSetti
 		if (textureCacheMaxOpenFileHandlesAttribute.isValid())
 			textureCacheMaxOpenFileHandles = textureCacheMaxOpenFileHandlesAttribute.getValue(744, false);
 
+		m_textureCacheSharedBudgetSize = 0;
+		if (gsHelper.getIntParam("texture_cache_shared_budget", 0) == 1)
+		{
+			unsigned int numActiveRenders = m_sharedTextureBudget.acquire();
+			if (numActiveRenders > 0)
+			{
+				// so our share can be re-balanced as other renders start and finish
+				m_textureCacheSharedBudgetSize = textureCacheMaxSize;
+			}
+			if (numActiveRenders > 1)
+			{
+				textureCacheMaxSize = SharedTextureBudget::calculateShare(textureCacheMaxSize, numActiveRenders);
+				m_logger.info("Sharing texture cache memory budget with %u other active render(s) - using %i MB.", numActiveRenders - 1, textureCacheMaxSize);
+				if ((unsigned int)textureCacheMaxSize < SharedTextureBudget::kLowShareMB)
+				{
+					m_logger.warning("Texture cache limit is very low, so texture reads are likely to thrash.");
+				}
+			}
+		}
+
 		GlobalContext::instance().setTextureCacheMemoryLimit(textureCacheMaxSize);
 		GlobalContext::instance().setTextureCacheFileHandleLimit(textureCacheMaxOpenFileHandles);
 
+		m_textureCacheMaxSize = textureCacheMaxSize;
+		m_textureCacheMaxFileHandles = textureCacheMaxOpenFileHandles;
+
 		FnKat::IntAttribute textureTileDataFixAttribute = imagineGSAttribute.getChildByName("texture_tile_data_fix");
 		int textureTileDataFixType = 0;
 		if (textureTileDataFixAttribute.isValid())
@@ -326,6 +406,16 @@ bool ImagineRender::configureRenderSettings(Foundry::Katana::Render::RenderSetti
 			m_renderSettings.add("textureGlobalMipmapBias", (float)textureCacheGlobalMipmapBias);
 		}
 	}
+
+	m_texturePreflight = gsHelper.getIntParam("texture_preflight", 0) == 1;
+
+	m_texturePrefetch = gsHelper.getIntParam("texture_prefetch", 0) == 1;
+	m_texturePrefetchMaxSize = gsHelper.getIntParam("texture_prefetch_max_size", 2048);
+
+	FnKat::StringAttribute textureConversionCachePathAttribute = imagineGSAttribute.getChildByName("texture_conversion_cache_path");
+	m_textureConversionCachePath = "";
+	if (textureConversionCachePathAttribute.isValid())
+		m_textureConversionCachePath = textureConversionCachePathAttribute.getValue("", false);
 	
 	int logOutputDestination = gsHelper.getIntParam("log_output_destination", 0);
 	int logOutputLevel = gsHelper.getIntParam("log_output_level", 1);
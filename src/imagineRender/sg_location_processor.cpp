@@ -19,7 +19,11 @@
 #include "sg_location_processor.h"
 
 #include <stdio.h>
+#include <string.h>
 
+#include <algorithm>
+
+#include <FnAttribute/FnGroupBuilder.h>
 #include <FnRenderOutputUtils/FnRenderOutputUtils.h>
 #include <FnGeolibServices/FnArbitraryOutputAttr.h>
 #include <FnGeolib/util/Path.h>
@@ -42,6 +46,9 @@
 
 using namespace Imagine;
 
+// see createCompactGeometryInstanceFromAttributes()
+static const unsigned int kMaxDeformationSegments = 1;
+
 SGLocationProcessor::SGLocationProcessor(Scene& scene, Logger& logger, const CreationSettings& creationSettings, IDState* pIDState)
 	: m_scene(scene), m_logger(logger), 
 	  m_creationSettings(creationSettings),
@@ -53,6 +60,11 @@ SGLocationProcessor::SGLocationProcessor(Scene& scene, Logger& logger, const Cre
 
 SGLocationProcessor::~SGLocationProcessor()
 {
+	std::map<const Object*, CompactGeometryInstance*>::iterator itLiveGeoInstance = m_aLiveGeometryInstances.begin();
+	for (; itLiveGeoInstance != m_aLiveGeometryInstances.end(); ++itLiveGeoInstance)
+	{
+		delete (*itLiveGeoInstance).second;
+	}
 
 }
 
@@ -63,7 +75,10 @@ void SGLocationProcessor::processSG(FnKat::FnScenegraphIterator rootIterator)
 
 void SGLocationProcessor::processSGForceExpand(FnKat::FnScenegraphIterator rootIterator)
 {
-	processLocationRecursive(rootIterator, 0);
+	XFormState rootXFormState;
+	processLocationRecursive(rootIterator, 0, rootXFormState);
+
+	m_materialHelper.printStatistics();
 }
 
 void SGLocationProcessor::getFinalMaterials(std::vector<Material*>& aMaterials)
@@ -91,10 +106,110 @@ void SGLocationProcessor::registerGeometryInstance(Imagine::GeometryInstance* pG
 	m_scene.getGeometryManager().addRawGeometryInstance(pGeoInstance);
 }
 
-void SGLocationProcessor::processLocationRecursive(const FnKat::FnScenegraphIterator& iterator, unsigned int currentDepth)
+void SGLocationProcessor::buildXFormState(const FnKat::FnScenegraphIterator& iterator, const XFormState& parentXFormState, XFormState& xformState)
+{
+	ExpansionProfiler::ScopedStage stageProfile(m_profiler, ExpansionProfiler::eStageXForm);
+
+	// once something up the hierarchy couldn't be accumulated, everything below it needs the global path as well
+	if (!parentXFormState.valid)
+	{
+		xformState.valid = false;
+		return;
+	}
+
+	FnKat::GroupAttribute localXFormAttr = iterator.getAttribute("xform");
+	if (!localXFormAttr.isValid())
+	{
+		xformState = parentXFormState;
+		return;
+	}
+
+	double localMatrix[16];
+	bool isAbsolute = false;
+	if (!KatanaHelpers::getLocalXFormMatrix(localXFormAttr, m_creationSettings.m_motionBlur, m_creationSettings.m_shutterOpen,
+											m_creationSettings.m_shutterClose, localMatrix, isAbsolute))
+	{
+		xformState.valid = false;
+		return;
+	}
+
+	if (isAbsolute)
+	{
+		// origin ops reset the inherited xform
+		memcpy(xformState.worldMatrix, localMatrix, sizeof(double) * 16);
+	}
+	else
+	{
+		KatanaHelpers::concatXFormMatrices(localMatrix, parentXFormState.worldMatrix, xformState.worldMatrix);
+	}
+
+	xformState.valid = true;
+}
+
+void SGLocationProcessor::getStaticWorldMatrix(const FnKat::FnScenegraphIterator& iterator, const XFormState& xformState, double* pMatrix)
+{
+	if (xformState.valid)
+	{
+		memcpy(pMatrix, xformState.worldMatrix, sizeof(double) * 16);
+		return;
+	}
+
+	FnKat::RenderOutputUtils::XFormMatrixVector xform = KatanaHelpers::getXFormMatrixStatic(iterator);
+	memcpy(pMatrix, xform[0].getValues(), sizeof(double) * 16);
+}
+
+void SGLocationProcessor::applyTransform(const FnKat::FnScenegraphIterator& iterator, const XFormState& xformState, Object* pObject,
+										 bool allowMotionBlur)
+{
+	ExpansionProfiler::ScopedStage stageProfile(m_profiler, ExpansionProfiler::eStageXForm);
+
+	// if the state's valid, the xform chain isn't animated, so we can use it even with motion blur enabled
+	if (!m_creationSettings.m_motionBlur || !allowMotionBlur || xformState.valid)
+	{
+		double worldMatrix[16];
+		getStaticWorldMatrix(iterator, xformState, worldMatrix);
+
+		setStaticTransform(worldMatrix, pObject);
+	}
+	else
+	{
+		// see if we've got multiple xform samples
+		FnKat::RenderOutputUtils::XFormMatrixVector xforms = KatanaHelpers::getXFormMatrixMB(iterator, true, m_creationSettings.m_shutterOpen,
+																							 m_creationSettings.m_shutterClose);
+		if (xforms.size() == 1)
+		{
+			// we haven't, so just assign transform normally...
+			setStaticTransform(xforms[0].getValues(), pObject);
+		}
+		else
+		{
+			const double* pMatrix0 = xforms[0].getValues();
+			const double* pMatrix1 = xforms[1].getValues();
+			bool decompose = m_creationSettings.m_decomposeXForms;
+			pObject->transform().setAnimatedCachedMatrix(pMatrix0, pMatrix1, true, decompose); // invert the matrix for transpose
+		}
+	}
+}
+
+void SGLocationProcessor::setStaticTransform(const double* pMatrix, Object* pObject)
+{
+	// objects default to an identity transform, so there's nothing to do for those
+	if (KatanaHelpers::isIdentityXFormMatrix(pMatrix))
+		return;
+
+	pObject->transform().setCachedMatrix(pMatrix, true); // invert the matrix for transpose
+}
+
+void SGLocationProcessor::processLocationRecursive(const FnKat::FnScenegraphIterator& iterator, unsigned int currentDepth,
+													const XFormState& parentXFormState)
 {
 	std::string type = iterator.getType();
 
+	ExpansionProfiler::ScopedLocation locationProfile(m_profiler, iterator, type);
+
+	XFormState xformState;
+	buildXFormState(iterator, parentXFormState, xformState);
+
 //	std::string fullName = iterator.getFullName();
 //	fprintf(stderr, "location: %s, type: %s\n", fullName.c_str(), type.c_str());
 
@@ -103,12 +218,12 @@ void SGLocationProcessor::processLocationRecursive(const FnKat::FnScenegraphIter
 		if (type == "polymesh")
 		{
 			// TODO: use SG location delegates...
-			processGeometryPolymeshCompact(iterator, false);
+			processGeometryPolymeshCompact(iterator, xformState, false);
 			return;
 		}
 		else if (type == "subdmesh")
 		{
-			processGeometryPolymeshCompact(iterator, true);
+			processGeometryPolymeshCompact(iterator, xformState, true);
 			return;
 		}
 	}
@@ -117,19 +232,19 @@ void SGLocationProcessor::processLocationRecursive(const FnKat::FnScenegraphIter
 		if (type == "polymesh" || type == "subdmesh")
 		{
 			// TODO: use SG location delegates...
-			processGeometryPolymeshCompact(iterator, false);
+			processGeometryPolymeshCompact(iterator, xformState, false);
 			return;
 		}
 	}
 
 	if (type == "instance")
 	{
-		processInstance(iterator);
+		processInstance(iterator, xformState);
 		return;
 	}
 	if (type == "instance array")
 	{
-		processInstanceArray(iterator);
+		processInstanceArray(iterator, xformState);
 		return;
 	}
 	if (type == "instance source")
@@ -139,25 +254,28 @@ void SGLocationProcessor::processLocationRecursive(const FnKat::FnScenegraphIter
 
 	if (m_creationSettings.m_specialiseType == CreationSettings::eAssembly && type == "assembly")
 	{
-		processSpecialisedType(iterator, currentDepth);
+		processSpecialisedType(iterator, xformState, currentDepth);
 		return;
 	}
 	if (m_creationSettings.m_specialiseType == CreationSettings::eComponent && type == "component")
 	{
-		processSpecialisedType(iterator, currentDepth);
+		processSpecialisedType(iterator, xformState, currentDepth);
 		return;
 	}
 	else if (type == "sphere" || type == "nurbspatch") // hack, but works for now...
 	{
-		processSphere(iterator);
+		processSphere(iterator, xformState);
 		return;
 	}
 	else if (type == "light")
 	{
-		processLight(iterator);
+		processLight(iterator, xformState);
 		return;
 	}
 
+	// don't include the children in this location's time
+	locationProfile.finish();
+
 	unsigned int nextDepth = currentDepth + 1;
 
 	const bool evictChildTraversal = true;
@@ -166,16 +284,25 @@ void SGLocationProcessor::processLocationRecursive(const FnKat::FnScenegraphIter
 	// evict so potentially Katana can free up memory for stuff that we've already processed.
 	for (; child.isValid(); child = child.getNextSibling(true))
 	{
-		processLocationRecursive(child, nextDepth);
+		processLocationRecursive(child, nextDepth, xformState);
 	}
 }
 
 #define FAST 0
 
-void SGLocationProcessor::processGeometryPolymeshCompact(const FnKat::FnScenegraphIterator& iterator, bool asSubD)
+void SGLocationProcessor::processGeometryPolymeshCompact(const FnKat::FnScenegraphIterator& iterator, const XFormState& xformState, bool asSubD)
 {
-	// get the geometry attributes group
-	FnKat::GroupAttribute geometryAttribute = iterator.getAttribute("geometry");
+	FnKat::GroupAttribute geometryAttribute;
+	FnKat::GroupAttribute imagineStatements;
+
+	{
+		ExpansionProfiler::ScopedStage stageProfile(m_profiler, ExpansionProfiler::eStageAttributeFetch);
+
+		// get the geometry attributes group
+		geometryAttribute = iterator.getAttribute("geometry");
+		imagineStatements = iterator.getAttribute("imagineStatements", true);
+	}
+
 	if (!geometryAttribute.isValid())
 	{
 		std::string name = iterator.getFullName();
@@ -183,20 +310,22 @@ void SGLocationProcessor::processGeometryPolymeshCompact(const FnKat::FnScenegra
 		return;
 	}
 
-	FnKat::GroupAttribute imagineStatements = iterator.getAttribute("imagineStatements", true);
-
 	// TODO: if we want to support facesets (modo's abc output annoyingly seems very pro-faceset) in the future, we're going
 	//       to have to check here if there are any children of type faceset/polymesh below this iterator. If so, we'd
 	//       need to ignore this location and just process the children.
 
 	CompactGeometryInstance* pNewGeoInstance = NULL;
-	if (!m_creationSettings.m_discardGeometry)
 	{
-		pNewGeoInstance = createCompactGeometryInstanceFromLocation(iterator, asSubD, imagineStatements);
-	}
-	else
-	{
-		pNewGeoInstance = createCompactGeometryInstanceFromLocationDiscard(iterator, asSubD, imagineStatements);
+		ExpansionProfiler::ScopedStage stageProfile(m_profiler, ExpansionProfiler::eStageConversion);
+
+		if (!m_creationSettings.m_discardGeometry)
+		{
+			pNewGeoInstance = createCompactGeometryInstanceFromLocation(iterator, asSubD, imagineStatements);
+		}
+		else
+		{
+			pNewGeoInstance = createCompactGeometryInstanceFromLocationDiscard(iterator, asSubD, imagineStatements);
+		}
 	}
 
 	if (!pNewGeoInstance)
@@ -212,85 +341,114 @@ void SGLocationProcessor::processGeometryPolymeshCompact(const FnKat::FnScenegra
 	pNewMeshObject->setCompactGeometryInstance(pNewGeoInstance);
 	registerGeometryInstance(pNewGeoInstance);
 
-	Material* pMaterial = m_materialHelper.getOrCreateMaterialForLocation(iterator, imagineStatements);
-	pNewMeshObject->setMaterial(pMaterial);
-
-	if (!m_creationSettings.m_motionBlur)
+	Material* pMaterial = NULL;
 	{
-		// do transform
-		FnKat::RenderOutputUtils::XFormMatrixVector xform = KatanaHelpers::getXFormMatrixStatic(iterator);
+		ExpansionProfiler::ScopedStage stageProfile(m_profiler, ExpansionProfiler::eStageMaterialLookup);
+		pMaterial = m_materialHelper.getOrCreateMaterialForLocation(iterator, imagineStatements);
+	}
+	setObjectMaterial(pNewMeshObject, pMaterial);
 
-		const double* pMatrix = xform[0].getValues();
-		pNewMeshObject->transform().setCachedMatrix(pMatrix, true); // invert the matrix for transpose
+	applyTransform(iterator, xformState, pNewMeshObject);
+
+	processVisibilityAttributes(imagineStatements, pNewMeshObject);
+
+	if (m_pIDState)
+	{
+		unsigned int objectID = sendObjectID(iterator);
+		pNewMeshObject->setObjectID(objectID);
 	}
-	else
+
+	addObjectToScene(pNewMeshObject, iterator);
+}
+
+Object* SGLocationProcessor::addLiveMeshObject(const std::string& location, const FnKat::GroupAttribute& locationAttributes, bool asSubD)
+{
+	FnKat::GroupAttribute imagineStatements = locationAttributes.getChildByName("imagineStatements");
+
+	CompactGeometryInstance* pNewGeoInstance = createCompactGeometryInstanceFromAttributes(location, locationAttributes, asSubD, imagineStatements);
+	if (!pNewGeoInstance)
 	{
-		// see if we've got multiple xform samples
-		FnKat::RenderOutputUtils::XFormMatrixVector xforms = KatanaHelpers::getXFormMatrixMB(iterator, true, m_creationSettings.m_shutterOpen,
-																							 m_creationSettings.m_shutterClose);
-		if (xforms.size() == 1)
-		{
-			// we haven't, so just assign transform normally...
-			const double* pMatrix = xforms[0].getValues();
-			pNewMeshObject->transform().setCachedMatrix(pMatrix, true); // invert the matrix for transpose
-		}
-		else
-		{
-			const double* pMatrix0 = xforms[0].getValues();
-			const double* pMatrix1 = xforms[1].getValues();
-			bool decompose = m_creationSettings.m_decomposeXForms;
-			pNewMeshObject->transform().setAnimatedCachedMatrix(pMatrix0, pMatrix1, true, decompose); // invert the matrix for transpose
-		}
+		return NULL;
 	}
 
+	pNewGeoInstance->setCustomFlags(getCustomGeoFlags());
+
+	CompactMesh* pNewMeshObject = new CompactMesh();
+
+	// we own these, rather than the geometry manager, so they can be freed when they're replaced
+	pNewMeshObject->setCompactGeometryInstance(pNewGeoInstance);
+	m_aLiveGeometryInstances[pNewMeshObject] = pNewGeoInstance;
+
+	setObjectMaterial(pNewMeshObject, getLiveMaterial(locationAttributes, imagineStatements));
+
 	processVisibilityAttributes(imagineStatements, pNewMeshObject);
 
+	// so it can be picked, and so it shows up in the ID AOV for working out where in the image it is
 	if (m_pIDState)
 	{
-		unsigned int objectID = sendObjectID(iterator);
+		unsigned int objectID = sendObjectID(location);
 		pNewMeshObject->setObjectID(objectID);
 	}
 
-	addObjectToScene(pNewMeshObject, iterator);
+	pNewMeshObject->setName(location, false);
+	m_scene.addObjectEmbedded(pNewMeshObject, true);
+
+	return pNewMeshObject;
 }
 
-void SGLocationProcessor::processSpecialisedType(const FnKat::FnScenegraphIterator& iterator, unsigned int currentDepth)
+bool SGLocationProcessor::replaceLiveMeshGeometry(Object* pObject, const std::string& location, const FnKat::GroupAttribute& locationAttributes,
+												  bool asSubD)
 {
-	CompoundObject* pCO = createCompoundObjectFromLocation(iterator, currentDepth);
+	CompactMesh* pMeshObject = dynamic_cast<CompactMesh*>(pObject);
+	if (!pMeshObject)
+	{
+		getLogger().warning("Can't replace geometry of location: %s as it's not a mesh.", location.c_str());
+		return false;
+	}
 
-	if (!pCO)
+	FnKat::GroupAttribute imagineStatements = locationAttributes.getChildByName("imagineStatements");
+
+	CompactGeometryInstance* pNewGeoInstance = createCompactGeometryInstanceFromAttributes(location, locationAttributes, asSubD, imagineStatements);
+	if (!pNewGeoInstance)
 	{
-		return;
+		return false;
 	}
 
-	if (!m_creationSettings.m_motionBlur)
+	pNewGeoInstance->setCustomFlags(getCustomGeoFlags());
+
+	pMeshObject->setCompactGeometryInstance(pNewGeoInstance);
+
+	// geometry instances from the initial expansion stay with the geometry manager, but ones from previous live
+	// edits are only used by this object, so can be freed now the render's been stopped. Otherwise every edit of
+	// a deformer would add another copy of the mesh for the rest of the session.
+	CompactGeometryInstance*& pLiveGeoInstance = m_aLiveGeometryInstances[pMeshObject];
+	if (pLiveGeoInstance)
 	{
-		// do transform
-		FnKat::RenderOutputUtils::XFormMatrixVector xform = KatanaHelpers::getXFormMatrixStatic(iterator);
+		delete pLiveGeoInstance;
+	}
+	pLiveGeoInstance = pNewGeoInstance;
 
-		const double* pMatrix = xform[0].getValues();
-		pCO->transform().setCachedMatrix(pMatrix, true); // invert the matrix for transpose
+	FnKat::GroupAttribute materialAttribute = locationAttributes.getChildByName("material");
+	if (materialAttribute.isValid())
+	{
+		setObjectMaterial(pMeshObject, getLiveMaterial(locationAttributes, imagineStatements));
 	}
-	else
+
+	return true;
+}
+
+void SGLocationProcessor::processSpecialisedType(const FnKat::FnScenegraphIterator& iterator, const XFormState& xformState,
+												 unsigned int currentDepth)
+{
+	CompoundObject* pCO = createCompoundObjectFromLocation(iterator, currentDepth);
+
+	if (!pCO)
 	{
-		// see if we've got multiple xform samples
-		FnKat::RenderOutputUtils::XFormMatrixVector xforms = KatanaHelpers::getXFormMatrixMB(iterator, true, m_creationSettings.m_shutterOpen,
-																							 m_creationSettings.m_shutterClose);
-		if (xforms.size() == 1)
-		{
-			// we haven't, so just assign transform normally...
-			const double* pMatrix = xforms[0].getValues();
-			pCO->transform().setCachedMatrix(pMatrix, true); // invert the matrix for transpose
-		}
-		else
-		{
-			const double* pMatrix0 = xforms[0].getValues();
-			const double* pMatrix1 = xforms[1].getValues();
-			bool decompose = m_creationSettings.m_decomposeXForms;
-			pCO->transform().setAnimatedCachedMatrix(pMatrix0, pMatrix1, true, decompose); // invert the matrix for transpose
-		}
+		return;
 	}
 
+	applyTransform(iterator, xformState, pCO);
+
 	addObjectToScene(pCO, iterator);
 }
 
@@ -303,6 +461,29 @@ CompactGeometryInstance* SGLocationProcessor::createCompactGeometryInstanceFromL
 		return NULL;
 	}
 
+	// these are refcounted, so this doesn't copy any of the actual data
+	FnKat::GroupBuilder locationAttributesBuilder;
+	locationAttributesBuilder.set("geometry", geometryAttribute);
+
+	FnKat::DoubleAttribute boundAttr = iterator.getAttribute("bound");
+	if (boundAttr.isValid())
+	{
+		locationAttributesBuilder.set("bound", boundAttr);
+	}
+
+	return createCompactGeometryInstanceFromAttributes(iterator.getFullName(), locationAttributesBuilder.build(), asSubD, imagineStatements);
+}
+
+CompactGeometryInstance* SGLocationProcessor::createCompactGeometryInstanceFromAttributes(const std::string& locationPath,
+																						  const FnKat::GroupAttribute& locationAttributes, bool asSubD,
+																						  const FnKat::GroupAttribute& imagineStatements)
+{
+	FnKat::GroupAttribute geometryAttribute = locationAttributes.getChildByName("geometry");
+	if (!geometryAttribute.isValid())
+	{
+		return NULL;
+	}
+
 	// default setting is false from the user's perspective, but in reality, we do the opposite
 	bool flipFaces = false;
 
@@ -335,11 +516,86 @@ CompactGeometryInstance* SGLocationProcessor::createCompactGeometryInstanceFromL
 	unsigned int numPointTimeSamples = 1;
 	numPointTimeSamples = (unsigned int)pAttr.getNumberOfTimeSamples();
 
-	if (!m_creationSettings.m_motionBlur || numPointTimeSamples <= 1)
+	// the sample times we actually use for the points, which the normals need to match
+	std::vector<float> aPointSampleTimes;
+	if (m_creationSettings.m_motionBlur && numPointTimeSamples > 1)
 	{
-		FnKat::FloatConstVector sampleData = pAttr.getNearestSample(0.0f);
+		// Imagine's CompactGeometryInstance and motion BVH only interpolate between the shutter open and close
+		// positions, so until the core supports more segments than that, the samples are thinned down to two.
+		unsigned int maxSegments = std::min(m_creationSettings.m_motionBlurMaxSegments, kMaxDeformationSegments);
+		KatanaHelpers::getMotionSampleTimes(pAttr, aPointSampleTimes, m_creationSettings.m_shutterOpen, m_creationSettings.m_shutterClose,
+											maxSegments);
+
+		// the points for all samples are stored interleaved, so they all need the same number
+		for (unsigned int s = 1; s < aPointSampleTimes.size(); s++)
+		{
+			if (pAttr.getNearestSample(aPointSampleTimes[s]).size() != pAttr.getNearestSample(aPointSampleTimes[0]).size())
+			{
+				getLogger().warning("geometry.point.P attribute on location '%s' has a different number of values in some time samples, ignoring deformation motion blur...",
+									locationPath.c_str());
+				aPointSampleTimes.resize(1);
+				break;
+			}
+		}
+	}
+
+	// if we've only got a single sample of P, see if there are velocities we can use for deformation blur instead
+	FnKat::FloatAttribute velocityAttr;
+	if (m_creationSettings.m_motionBlur && aPointSampleTimes.size() <= 1 && m_creationSettings.m_velocityScale != 0.0f)
+	{
+		velocityAttr = pointAttribute.getChildByName("v");
+		if (velocityAttr.isValid() && velocityAttr.getNumberOfValues() != pAttr.getNumberOfValues())
+		{
+			getLogger().warning("geometry.point.v attribute on location '%s' does not have the same number of values as P, ignoring velocities...", locationPath.c_str());
+			velocityAttr = FnKat::FloatAttribute();
+		}
+	}
+
+	if (velocityAttr.isValid())
+	{
+		// shutter offsets need to be relative to when P was actually sampled, which isn't necessarily frame time
+		float pointSampleTime = aPointSampleTimes.empty() ? pAttr.getSampleTime(0) : aPointSampleTimes[0];
+		FnKat::FloatConstVector sampleData = pAttr.getNearestSample(pointSampleTime);
+		FnKat::FloatConstVector velocityData = velocityAttr.getNearestSample(pointSampleTime);
 
 		unsigned int numItems = sampleData.size();
+		m_profiler.addAttributeBytes(numItems * 2 * sizeof(float));
+
+		// velocities are converted to units per frame by the scale (which includes the frame rate), so the
+		// offsets are relative to the time P was sampled at.
+		float openOffset = (m_creationSettings.m_shutterOpen - pointSampleTime) * m_creationSettings.m_velocityScale;
+		float closeOffset = (m_creationSettings.m_shutterClose - pointSampleTime) * m_creationSettings.m_velocityScale;
+
+		aPoints.resize((numItems / 3) * 2);
+		// convert to Point items, with the shutter open and close positions stored contiguously for each
+		// point, exactly as if two samples of P had been authored.
+		unsigned int pointCount = 0;
+		for (unsigned int i = 0; i < numItems; i += 3)
+		{
+			Point& point0 = aPoints[pointCount++];
+			point0.x = sampleData[i] + velocityData[i] * openOffset;
+			point0.y = sampleData[i + 1] + velocityData[i + 1] * openOffset;
+			point0.z = sampleData[i + 2] + velocityData[i + 2] * openOffset;
+
+			Point& point1 = aPoints[pointCount++];
+			point1.x = sampleData[i] + velocityData[i] * closeOffset;
+			point1.y = sampleData[i + 1] + velocityData[i + 1] * closeOffset;
+			point1.z = sampleData[i + 2] + velocityData[i + 2] * closeOffset;
+		}
+
+		pNewGeoInstance->setTimeSamples(2);
+
+		// normals (which will just be the single sample duplicated) get looked up at these
+		aPointSampleTimes.clear();
+		aPointSampleTimes.push_back(m_creationSettings.m_shutterOpen);
+		aPointSampleTimes.push_back(m_creationSettings.m_shutterClose);
+	}
+	else if (aPointSampleTimes.size() <= 1)
+	{
+		FnKat::FloatConstVector sampleData = pAttr.getNearestSample(aPointSampleTimes.empty() ? 0.0f : aPointSampleTimes[0]);
+
+		unsigned int numItems = sampleData.size();
+		m_profiler.addAttributeBytes(numItems * sizeof(float));
 
 #if FAST
 		aPoints.resize(numItems / 3);
@@ -367,33 +623,36 @@ CompactGeometryInstance* SGLocationProcessor::createCompactGeometryInstanceFromL
 	}
 	else
 	{
-		std::vector<float> aSampleTimes;
-		KatanaHelpers::getRelevantSampleTimes(pAttr, aSampleTimes, m_creationSettings.m_shutterOpen, m_creationSettings.m_shutterClose);
-		FnKat::FloatConstVector sampleData0 = pAttr.getNearestSample(aSampleTimes[0]);
-		FnKat::FloatConstVector sampleData1 = pAttr.getNearestSample(aSampleTimes[aSampleTimes.size() - 1]);
-
-		unsigned int numItems = sampleData0.size();
+		unsigned int numSamples = aPointSampleTimes.size();
 
-		aPoints.reserve((numItems / 3) * 2);
-		// convert to Point items
-		for (unsigned int i = 0; i < numItems; i += 3)
+		std::vector<FnKat::FloatConstVector> aSampleData;
+		aSampleData.reserve(numSamples);
+		for (unsigned int s = 0; s < numSamples; s++)
 		{
-			float x = sampleData0[i];
-			float y = sampleData0[i + 1];
-			float z = sampleData0[i + 2];
-
-			aPoints.push_back(Point(x, y, z));
+			aSampleData.push_back(pAttr.getNearestSample(aPointSampleTimes[s]));
+		}
 
-			// second sample
+		unsigned int numItems = aSampleData[0].size();
+		m_profiler.addAttributeBytes(numItems * numSamples * sizeof(float));
 
-			x = sampleData1[i];
-			y = sampleData1[i + 1];
-			z = sampleData1[i + 2];
+		aPoints.resize((numItems / 3) * numSamples);
+		// convert to Point items - all the samples for each point are stored contiguously, so
+		// each point's motion segments are local in memory.
+		unsigned int pointCount = 0;
+		for (unsigned int i = 0; i < numItems; i += 3)
+		{
+			for (unsigned int s = 0; s < numSamples; s++)
+			{
+				const FnKat::FloatConstVector& sampleData = aSampleData[s];
 
-			aPoints.push_back(Point(x, y, z));
+				Point& point = aPoints[pointCount++];
+				point.x = sampleData[i];
+				point.y = sampleData[i + 1];
+				point.z = sampleData[i + 2];
+			}
 		}
 
-		pNewGeoInstance->setTimeSamples(2);
+		pNewGeoInstance->setTimeSamples(numSamples);
 	}
 
 	// work out the faces...
@@ -419,6 +678,7 @@ CompactGeometryInstance* SGLocationProcessor::createCompactGeometryInstanceFromL
 	aPolyOffsets.reserve(numFaces);
 
 	unsigned int numIndices = vertexListAttributeValue.size();
+	m_profiler.addAttributeBytes((numIndices + polyStartIndexAttributeValue.size()) * sizeof(int));
 	std::vector<uint32_t>& aPolyIndices = pNewGeoInstance->getPolygonIndices();
 	aPolyIndices.resize(numIndices);
 
@@ -479,7 +739,7 @@ CompactGeometryInstance* SGLocationProcessor::createCompactGeometryInstanceFromL
 	}
 	
 	// see if we've got any Normals....
-	FnKat::FloatAttribute normalsAttribute = iterator.getAttribute("geometry.vertex.N");
+	FnKat::FloatAttribute normalsAttribute = locationAttributes.getChildByName("geometry.vertex.N");
 	if (m_creationSettings.m_useGeoNormals && normalsAttribute.isValid() && !asSubD)
 	{
 		// check if the points had more than one time sample...
@@ -488,10 +748,11 @@ CompactGeometryInstance* SGLocationProcessor::createCompactGeometryInstanceFromL
 			FnKat::FloatConstVector normalsData = normalsAttribute.getNearestSample(0.0f);
 
 			unsigned int numItems = normalsData.size();
+			m_profiler.addAttributeBytes(numItems * sizeof(float));
 			
 			if (numItems == 0 || numItems % 3 != 0)
 			{
-				getLogger().warning("geometry.vertex.N attribute on location '%s' does not have the expected number of values, ignoring normals...", iterator.getFullName().c_str());
+				getLogger().warning("geometry.vertex.N attribute on location '%s' does not have the expected number of values, ignoring normals...", locationPath.c_str());
 				geoBuildFlags |= GeometryInstance::GEO_BUILD_CALC_VERT_NORMALS;
 			}
 			else
@@ -517,41 +778,44 @@ CompactGeometryInstance* SGLocationProcessor::createCompactGeometryInstanceFromL
 		{
 			std::vector<Normal>& aNormals = pNewGeoInstance->getNormals();
 
-			std::vector<float> aSampleTimes;
-			KatanaHelpers::getRelevantSampleTimes(normalsAttribute, aSampleTimes, m_creationSettings.m_shutterOpen, m_creationSettings.m_shutterClose);
+			// we need exactly the same number of normal samples as point samples, so look up the
+			// normals at the point sample times, rather than working them out independently.
+			unsigned int numSamples = pNewGeoInstance->getTimeSamples();
 
-			FnKat::FloatConstVector sampleData0 = normalsAttribute.getNearestSample(aSampleTimes[0]);
-			FnKat::FloatConstVector sampleData1 = normalsAttribute.getNearestSample(aSampleTimes[aSampleTimes.size() - 1]);
+			std::vector<FnKat::FloatConstVector> aSampleData;
+			aSampleData.reserve(numSamples);
+			for (unsigned int s = 0; s < numSamples; s++)
+			{
+				aSampleData.push_back(normalsAttribute.getNearestSample(aPointSampleTimes[s]));
+			}
 
-			unsigned int numItems = sampleData0.size();
+			unsigned int numItems = aSampleData[0].size();
+			m_profiler.addAttributeBytes(numItems * numSamples * sizeof(float));
 			
 			if (numItems == 0 || numItems % 3 != 0)
 			{
-				getLogger().warning("geometry.vertex.N attribute on location '%s' does not have the expected number of values, ignoring normals...", iterator.getFullName().c_str());
+				getLogger().warning("geometry.vertex.N attribute on location '%s' does not have the expected number of values, ignoring normals...", locationPath.c_str());
 				geoBuildFlags |= GeometryInstance::GEO_BUILD_CALC_VERT_NORMALS;
 			}
 			else
 			{
-				aNormals.reserve((numItems / 3) * 2);
+				aNormals.resize((numItems / 3) * numSamples);
 	
 				// convert to Normal items
+				unsigned int normalCount = 0;
 				for (unsigned int i = 0; i < numItems; i += 3)
 				{
-					// first sample
-					float x = sampleData0[i];
-					float y = sampleData0[i + 1];
-					float z = sampleData0[i + 2];
-	
-					// we need to reverse the normals as the winding order is opposite...
-					aNormals.push_back(Normal(-x, -y, -z));
-	
-					// second sample
-					x = sampleData1[i];
-					y = sampleData1[i + 1];
-					z = sampleData1[i + 2];
-	
-					// we need to reverse the normals as the winding order is opposite...
-					aNormals.push_back(Normal(-x, -y, -z));
+					for (unsigned int s = 0; s < numSamples; s++)
+					{
+						const FnKat::FloatConstVector& sampleData = aSampleData[s];
+
+						Normal& normal = aNormals[normalCount++];
+
+						// we need to reverse the normals as the winding order is opposite...
+						normal.x = -sampleData[i];
+						normal.y = -sampleData[i + 1];
+						normal.z = -sampleData[i + 2];
+					}
 				}
 			}
 		}
@@ -572,7 +836,7 @@ CompactGeometryInstance* SGLocationProcessor::createCompactGeometryInstanceFromL
 	bool hasUVs = false;
 	bool indexedUVs = false;
 	// copy any UVs
-	FnKat::GroupAttribute stAttribute = iterator.getAttribute("geometry.arbitrary.st", true);
+	FnKat::GroupAttribute stAttribute = locationAttributes.getChildByName("geometry.arbitrary.st");
 	FnKat::FloatAttribute uvItemAttribute;
 	if (stAttribute.isValid())
 	{
@@ -598,11 +862,11 @@ CompactGeometryInstance* SGLocationProcessor::createCompactGeometryInstanceFromL
 	// we didn't find them in general place, so try and look for them in other locations...
 	if (!uvItemAttribute.isValid())
 	{
-		uvItemAttribute = iterator.getAttribute("geometry.vertex.uv");
+		uvItemAttribute = locationAttributes.getChildByName("geometry.vertex.uv");
 
 		if (!uvItemAttribute.isValid())
 		{
-			uvItemAttribute = iterator.getAttribute("geometry.point.uv");
+			uvItemAttribute = locationAttributes.getChildByName("geometry.point.uv");
 		}
 	}
 
@@ -613,6 +877,7 @@ CompactGeometryInstance* SGLocationProcessor::createCompactGeometryInstanceFromL
 		hasUVs = true;
 		std::vector<UV>& aUVs = pNewGeoInstance->getUVs();
 		FnKat::FloatConstVector uvlist = uvItemAttribute.getNearestSample(0);
+		m_profiler.addAttributeBytes(uvlist.size() * sizeof(float));
 		
 		numUVValues = processUVs(uvlist, aUVs);
 	}
@@ -634,6 +899,7 @@ CompactGeometryInstance* SGLocationProcessor::createCompactGeometryInstanceFromL
 		{
 			// if indexed, get hold the uv indices list
 			FnKat::IntConstVector uvIndicesValue = uvIndexAttribute.getNearestSample(0.0f);
+			m_profiler.addAttributeBytes(uvIndicesValue.size() * sizeof(int));
 
 #if FAST
 			// this isn't technically correct, but as long as we're only using 31 bits, will work...
@@ -700,7 +966,7 @@ CompactGeometryInstance* SGLocationProcessor::createCompactGeometryInstanceFromL
 	bool reverseOrientation = !flipFaces;
 	pNewGeoInstance->setHasReverseOrientation(reverseOrientation);
 
-	FnKat::DoubleAttribute boundAttr = iterator.getAttribute("bound");
+	FnKat::DoubleAttribute boundAttr = locationAttributes.getChildByName("bound");
 	if (m_creationSettings.m_useBounds && boundAttr.isValid())
 	{
 		if (!m_creationSettings.m_motionBlur || pNewGeoInstance->getTimeSamples() == 1)
@@ -766,15 +1032,29 @@ CompactGeometryInstance* SGLocationProcessor::createCompactGeometryInstanceFromL
 		FnKat::FloatConstVector sampleData = pAttr.getNearestSample(0.0f);
 
 		unsigned int numItems = sampleData.size();
+
+		if (m_creationSettings.m_motionBlur && m_creationSettings.m_velocityScale != 0.0f)
+		{
+			FnKat::FloatAttribute velocityAttr = pointAttribute.getChildByName("v");
+			if (velocityAttr.isValid())
+			{
+				FnKat::FloatConstVector velocityData = velocityAttr.getNearestSample(0.0f);
+
+				unsigned int numVelocityItems = velocityData.size();
+			}
+		}
 	}
 	else
 	{
 		std::vector<float> aSampleTimes;
-		KatanaHelpers::getRelevantSampleTimes(pAttr, aSampleTimes, m_creationSettings.m_shutterOpen, m_creationSettings.m_shutterClose);
-		FnKat::FloatConstVector sampleData0 = pAttr.getNearestSample(aSampleTimes[0]);
-		FnKat::FloatConstVector sampleData1 = pAttr.getNearestSample(aSampleTimes[aSampleTimes.size() - 1]);
+		KatanaHelpers::getMotionSampleTimes(pAttr, aSampleTimes, m_creationSettings.m_shutterOpen, m_creationSettings.m_shutterClose,
+											m_creationSettings.m_motionBlurMaxSegments);
+		for (unsigned int s = 0; s < aSampleTimes.size(); s++)
+		{
+			FnKat::FloatConstVector sampleData = pAttr.getNearestSample(aSampleTimes[s]);
 
-		unsigned int numItems = sampleData0.size();
+			unsigned int numItems = sampleData.size();
+		}
 	}
 
 	// work out the faces...
@@ -803,12 +1083,14 @@ CompactGeometryInstance* SGLocationProcessor::createCompactGeometryInstanceFromL
 		else
 		{
 			std::vector<float> aSampleTimes;
-			KatanaHelpers::getRelevantSampleTimes(normalsAttribute, aSampleTimes, m_creationSettings.m_shutterOpen, m_creationSettings.m_shutterClose);
-
-			FnKat::FloatConstVector sampleData0 = normalsAttribute.getNearestSample(aSampleTimes[0]);
-			FnKat::FloatConstVector sampleData1 = normalsAttribute.getNearestSample(aSampleTimes[aSampleTimes.size() - 1]);
+			KatanaHelpers::getMotionSampleTimes(normalsAttribute, aSampleTimes, m_creationSettings.m_shutterOpen, m_creationSettings.m_shutterClose,
+												m_creationSettings.m_motionBlurMaxSegments);
+			for (unsigned int s = 0; s < aSampleTimes.size(); s++)
+			{
+				FnKat::FloatConstVector sampleData = normalsAttribute.getNearestSample(aSampleTimes[s]);
 
-			unsigned int numItems = sampleData0.size();
+				unsigned int numItems = sampleData.size();
+			}
 		}
 	}
 
@@ -992,7 +1274,7 @@ void SGLocationProcessor::createCompoundObjectFromLocationRecursive(const FnKat:
 
 		if (pMaterial)
 		{
-			pNewMeshObject->setMaterial(pMaterial);
+			setObjectMaterial(pNewMeshObject, pMaterial);
 		}
 		else
 		{
@@ -1198,7 +1480,7 @@ SGLocationProcessor::InstanceInfo SGLocationProcessor::findOrBuildInstanceSource
 	return nullInfo;
 }
 
-void SGLocationProcessor::processInstance(const FnKat::FnScenegraphIterator& iterator)
+void SGLocationProcessor::processInstance(const FnKat::FnScenegraphIterator& iterator, const XFormState& xformState)
 {
 	FnKat::StringAttribute instanceSourceAttribute = iterator.getAttribute("geometry.instanceSource");
 	if (!instanceSourceAttribute.isValid())
@@ -1261,16 +1543,20 @@ void SGLocationProcessor::processInstance(const FnKat::FnScenegraphIterator& ite
 		// if it's a single object, we can assign a material to it, so look for one...
 
 		// we don't want to fall back to the default in this case, as we'll use the source instance's material if there is one
-		Material* pMaterial = m_materialHelper.getOrCreateMaterialForLocation(iterator, imagineStatements, false);
+		Material* pMaterial = NULL;
+		{
+			ExpansionProfiler::ScopedStage stageProfile(m_profiler, ExpansionProfiler::eStageMaterialLookup);
+			pMaterial = m_materialHelper.getOrCreateMaterialForLocation(iterator, imagineStatements, false);
+		}
 
 		if (pMaterial)
 		{
-			pNewObject->setMaterial(pMaterial);
+			setObjectMaterial(pNewObject, pMaterial);
 		}
 		else
 		{
 			// otherwise set the material to be the source instance's material
-			pNewObject->setMaterial(instanceInfo.pSingleItemMaterial);
+			setObjectMaterial(pNewObject, instanceInfo.pSingleItemMaterial);
 		}
 	}
 
@@ -1278,33 +1564,7 @@ void SGLocationProcessor::processInstance(const FnKat::FnScenegraphIterator& ite
 	
 	if (!instanceInfo.haveXForm)
 	{
-		if (!m_creationSettings.m_motionBlur)
-		{
-			// do transform
-			FnKat::RenderOutputUtils::XFormMatrixVector xform = KatanaHelpers::getXFormMatrixStatic(iterator);
-	
-			const double* pMatrix = xform[0].getValues();
-			pNewObject->transform().setCachedMatrix(pMatrix, true); // invert the matrix for transpose
-		}
-		else
-		{
-			// see if we've got multiple xform samples
-			FnKat::RenderOutputUtils::XFormMatrixVector xforms = KatanaHelpers::getXFormMatrixMB(iterator, true, m_creationSettings.m_shutterOpen,
-																								 m_creationSettings.m_shutterClose);
-			if (xforms.size() == 1)
-			{
-				// we haven't, so just assign transform normally...
-				const double* pMatrix = xforms[0].getValues();
-				pNewObject->transform().setCachedMatrix(pMatrix, true); // invert the matrix for transpose
-			}
-			else
-			{
-				const double* pMatrix0 = xforms[0].getValues();
-				const double* pMatrix1 = xforms[1].getValues();
-				bool decompose = m_creationSettings.m_decomposeXForms;
-				pNewObject->transform().setAnimatedCachedMatrix(pMatrix0, pMatrix1, true, decompose); // invert the matrix for transpose
-			}
-		}
+		applyTransform(iterator, xformState, pNewObject);
 	}
 	else
 	{
@@ -1312,11 +1572,11 @@ void SGLocationProcessor::processInstance(const FnKat::FnScenegraphIterator& ite
 		// transform order...
 		
 		// TODO: motion blur support
-		FnKat::RenderOutputUtils::XFormMatrixVector xform = KatanaHelpers::getXFormMatrixStatic(iterator);
+		double worldMatrix[16];
+		getStaticWorldMatrix(iterator, xformState, worldMatrix);
 
-		const double* pMatrix = xform[0].getValues();
 		Matrix4 transformValues;
-		transformValues.setFromArray(pMatrix, true);
+		transformValues.setFromArray(worldMatrix, true);
 		transformValues = Matrix4::multiply(transformValues, instanceInfo.xform);
 		pNewObject->transform().setCachedMatrix(transformValues);
 	}
@@ -1330,7 +1590,7 @@ void SGLocationProcessor::processInstance(const FnKat::FnScenegraphIterator& ite
 	addObjectToScene(pNewObject, iterator);
 }
 
-void SGLocationProcessor::processInstanceArray(const FnKat::FnScenegraphIterator& iterator)
+void SGLocationProcessor::processInstanceArray(const FnKat::FnScenegraphIterator& iterator, const XFormState& xformState)
 {
 	FnKat::StringAttribute instanceSourceAttribute = iterator.getAttribute("geometry.instanceSource");
 	if (!instanceSourceAttribute.isValid())
@@ -1393,9 +1653,10 @@ void SGLocationProcessor::processInstanceArray(const FnKat::FnScenegraphIterator
 	// get hold of the location hierarchy xform
 	// unfortunately, due to the way we're creating these and we don't have a graphics state hierarchy,
 	// we have to manually concat the matrices for each instance item ourself, which isn't great, but...
-	FnKat::RenderOutputUtils::XFormMatrixVector xforms = KatanaHelpers::getXFormMatrixStatic(iterator);
+	double worldMatrix[16];
+	getStaticWorldMatrix(iterator, xformState, worldMatrix);
 	Matrix4 baseTransform;
-	baseTransform.setFromArray(xforms[0].getValues(), true);
+	baseTransform.setFromArray(worldMatrix, true);
 	
 	bool isIdentityBaseTransform = baseTransform.isIdentity();
 
@@ -1441,7 +1702,11 @@ void SGLocationProcessor::processInstanceArray(const FnKat::FnScenegraphIterator
 	unsigned char renderVisibilityFlags = getRenderVisibilityFlags(imagineStatements);
 	
 	// we don't want to fall back to the default in this case, as we'll use the source instance's material if there is one
-	Material* pMaterial = m_materialHelper.getOrCreateMaterialForLocation(iterator, imagineStatements, false);
+	Material* pMaterial = NULL;
+	{
+		ExpansionProfiler::ScopedStage stageProfile(m_profiler, ExpansionProfiler::eStageMaterialLookup);
+		pMaterial = m_materialHelper.getOrCreateMaterialForLocation(iterator, imagineStatements, false);
+	}
 
 	for (size_t i = 0; i < numInstances; i++)
 	{
@@ -1475,12 +1740,12 @@ void SGLocationProcessor::processInstanceArray(const FnKat::FnScenegraphIterator
 
 			if (pMaterial)
 			{
-				pNewObject->setMaterial(pMaterial);
+				setObjectMaterial(pNewObject, pMaterial);
 			}
 			else
 			{
 				// otherwise set the material to be the source instance's material
-				pNewObject->setMaterial(instanceInfo.pSingleItemMaterial);
+				setObjectMaterial(pNewObject, instanceInfo.pSingleItemMaterial);
 			}
 			
 			// because we're using the common CompactMesh class for single instance items, we need to set this flag for the moment, so that baked geo instances
@@ -1525,7 +1790,7 @@ void SGLocationProcessor::processInstanceArray(const FnKat::FnScenegraphIterator
 	}
 }
 
-void SGLocationProcessor::processSphere(const FnKat::FnScenegraphIterator& iterator)
+void SGLocationProcessor::processSphere(const FnKat::FnScenegraphIterator& iterator, const XFormState& xformState)
 {
 	float radius = 1.0f;
 
@@ -1545,38 +1810,16 @@ void SGLocationProcessor::processSphere(const FnKat::FnScenegraphIterator& itera
 	Sphere* pSphere = new Sphere((float)radius, 16);
 
 	FnKat::GroupAttribute imagineStatements = iterator.getAttribute("imagineStatements", true);
-	Material* pMaterial = m_materialHelper.getOrCreateMaterialForLocation(iterator, imagineStatements);
-	pSphere->setMaterial(pMaterial);
+	Material* pMaterial = NULL;
+	{
+		ExpansionProfiler::ScopedStage stageProfile(m_profiler, ExpansionProfiler::eStageMaterialLookup);
+		pMaterial = m_materialHelper.getOrCreateMaterialForLocation(iterator, imagineStatements);
+	}
+	setObjectMaterial(pSphere, pMaterial);
 
 	// do transform
 
-	if (!m_creationSettings.m_motionBlur)
-	{
-		// do transform
-		FnKat::RenderOutputUtils::XFormMatrixVector xform = KatanaHelpers::getXFormMatrixStatic(iterator);
-
-		const double* pMatrix = xform[0].getValues();
-		pSphere->transform().setCachedMatrix(pMatrix, true); // invert the matrix for transpose
-	}
-	else
-	{
-		// see if we've got multiple xform samples
-		FnKat::RenderOutputUtils::XFormMatrixVector xforms = KatanaHelpers::getXFormMatrixMB(iterator, true, m_creationSettings.m_shutterOpen,
-																							 m_creationSettings.m_shutterClose);
-		if (xforms.size() == 1)
-		{
-			// we haven't, so just assign transform normally...
-			const double* pMatrix = xforms[0].getValues();
-			pSphere->transform().setCachedMatrix(pMatrix, true); // invert the matrix for transpose
-		}
-		else
-		{
-			const double* pMatrix0 = xforms[0].getValues();
-			const double* pMatrix1 = xforms[1].getValues();
-			bool decompose = m_creationSettings.m_decomposeXForms;
-			pSphere->transform().setAnimatedCachedMatrix(pMatrix0, pMatrix1, true, decompose); // invert the matrix for transpose
-		}
-	}
+	applyTransform(iterator, xformState, pSphere);
 	
 	processVisibilityAttributes(imagineStatements, pSphere);
 
@@ -1589,7 +1832,7 @@ void SGLocationProcessor::processSphere(const FnKat::FnScenegraphIterator& itera
 	addObjectToScene(pSphere, iterator);
 }
 
-void SGLocationProcessor::processLight(const FnKat::FnScenegraphIterator& iterator)
+void SGLocationProcessor::processLight(const FnKat::FnScenegraphIterator& iterator, const XFormState& xformState)
 {
 	FnKat::GroupAttribute lightMaterialAttrib = m_materialHelper.getMaterialForLocation(iterator);
 	
@@ -1619,10 +1862,8 @@ void SGLocationProcessor::processLight(const FnKat::FnScenegraphIterator& iterat
 		pNewLight->setMuted(true);
 	}
 
-	FnKat::RenderOutputUtils::XFormMatrixVector xforms = KatanaHelpers::getXFormMatrixStatic(iterator);
-	const double* pMatrix = xforms[0].getValues();
-
-	pNewLight->transform().setCachedMatrix(pMatrix, true); // invert the matrix for transpose
+	// lights don't support motion blur currently
+	applyTransform(iterator, xformState, pNewLight, false);
 
 	FnKat::GroupAttribute imagineStatements = iterator.getAttribute("imagineStatements", true);
 	processVisibilityAttributes(imagineStatements, pNewLight);
@@ -1732,6 +1973,13 @@ unsigned int SGLocationProcessor::processUVs(FnKat::FloatConstVector& uvlist, st
 }
 
 unsigned int SGLocationProcessor::sendObjectID(const FnKat::FnScenegraphIterator& iterator)
+{
+	ExpansionProfiler::ScopedStage stageProfile(m_profiler, ExpansionProfiler::eStageIDSend);
+
+	return sendObjectID(iterator.getFullName());
+}
+
+unsigned int SGLocationProcessor::sendObjectID(const std::string& location)
 {
 	int64_t objectID = m_pIDState->getNextID();
 
@@ -1740,14 +1988,63 @@ unsigned int SGLocationProcessor::sendObjectID(const FnKat::FnScenegraphIterator
 	// and then katanaBin dies during render, so we need to be careful on our side.
 	if (objectID > 0)
 	{
-		std::string name = iterator.getFullName();
-
-		m_pIDState->sendID(objectID, name.c_str());
+		m_pIDState->sendID(objectID, location.c_str());
 	}
 
 	return static_cast<unsigned int>(objectID);
 }
 
+void SGLocationProcessor::setObjectMaterial(Object* pObject, Material* pMaterial)
+{
+	// only live edits need to know how widely a material's shared
+	if (m_isLiveRender)
+	{
+		m_materialHelper.removeMaterialUser(pObject->getMaterial());
+		m_materialHelper.addMaterialUser(pMaterial);
+	}
+
+	pObject->setMaterial(pMaterial);
+}
+
+Material* SGLocationProcessor::getLiveMaterial(const FnKat::GroupAttribute& locationAttributes, const FnKat::GroupAttribute& imagineStatements)
+{
+	// live updates come with the flattened material (if any) for the location
+	FnKat::GroupAttribute materialAttribute = locationAttributes.getChildByName("material");
+	if (!materialAttribute.isValid())
+	{
+		return m_materialHelper.getDefaultMaterial();
+	}
+
+	size_t numExistingMaterials = m_materialHelper.getMaterialsVector().size();
+
+	Material* pMaterial = m_materialHelper.getOrCreateMaterial(materialAttribute, materialAttribute.getHash().uint64(), imagineStatements);
+
+	// if it's a new material, it won't have been through the material manager like the ones from the initial expansion
+	registerNewLiveMaterials(numExistingMaterials, true);
+
+	return pMaterial;
+}
+
+void SGLocationProcessor::registerNewLiveMaterials(size_t firstNewMaterial, bool preRender)
+{
+	std::vector<Material*>& aMaterials = m_materialHelper.getMaterialsVector();
+	if (firstNewMaterial >= aMaterials.size())
+		return;
+
+	std::vector<Material*> aNewMaterials(aMaterials.begin() + firstNewMaterial, aMaterials.end());
+
+	if (preRender)
+	{
+		std::vector<Material*>::iterator itMaterial = aNewMaterials.begin();
+		for (; itMaterial != aNewMaterials.end(); ++itMaterial)
+		{
+			(*itMaterial)->preRenderMaterial();
+		}
+	}
+
+	m_scene.getMaterialManager().addMaterialsLazy(aNewMaterials);
+}
+
 unsigned int SGLocationProcessor::getCustomGeoFlags()
 {
 	unsigned int customFlags = 0;
@@ -28,6 +28,7 @@
 #include "material_helper.h"
 #include "light_helpers.h"
 #include "misc_helpers.h"
+#include "expansion_profiler.h"
 
 #include "materials/material.h"
 #include "scene.h"
@@ -72,6 +73,22 @@ public:
 		Imagine::Material*						pSingleItemMaterial;
 	};
 
+	// accumulated world xform carried down the recursion, so that each location only needs to evaluate
+	// its own local xform rather than the whole parent chain again.
+	struct XFormState
+	{
+		XFormState() : valid(true)
+		{
+			for (unsigned int i = 0; i < 16; i++)
+			{
+				worldMatrix[i] = (i % 5 == 0) ? 1.0 : 0.0;
+			}
+		}
+
+		double		worldMatrix[16];
+		bool		valid; // false if the matrix couldn't be accumulated (i.e. animated), so the global xform path is needed
+	};
+
 	void processSG(FnKat::FnScenegraphIterator rootIterator);
 	void processSGForceExpand(FnKat::FnScenegraphIterator rootIterator);
 
@@ -79,20 +96,51 @@ public:
 	
 	void setIsLiveRender(bool liveRender) { m_isLiveRender = liveRender; }
 
+	ExpansionProfiler& getProfiler() { return m_profiler; }
+
+	MaterialHelper& getMaterialHelper() { return m_materialHelper; }
+
+	// for live rendering, where the processor is kept around after the initial expansion: builds a new mesh object from
+	// the attributes of a location (as sent with live updates) and adds it to the scene
+	Imagine::Object* addLiveMeshObject(const std::string& location, const FnKat::GroupAttribute& locationAttributes, bool asSubD);
+	// replaces the geometry (and material if there is one) of an existing mesh object with ones built from the attributes
+	bool replaceLiveMeshGeometry(Imagine::Object* pObject, const std::string& location, const FnKat::GroupAttribute& locationAttributes,
+								 bool asSubD);
+
+	// all material assignments should go through this, so for live renders the material helper knows how many objects
+	// use each material
+	void setObjectMaterial(Imagine::Object* pObject, Imagine::Material* pMaterial);
+
+	// for live rendering: adds any materials the material helper has created since it had firstNewMaterial materials
+	// to the scene's material manager (optionally pre-rendering them first), as the initial expansion does for the rest
+	void registerNewLiveMaterials(size_t firstNewMaterial, bool preRender);
+
 protected:
 	
 	void addObjectToScene(Imagine::Object* pObject, const FnKat::FnScenegraphIterator& sgIterator);
 	
 	void registerGeometryInstance(Imagine::GeometryInstance* pGeoInstance);
 
-	void processLocationRecursive(const FnKat::FnScenegraphIterator& iterator, unsigned int currentDepth);
+	void buildXFormState(const FnKat::FnScenegraphIterator& iterator, const XFormState& parentXFormState, XFormState& xformState);
+	void getStaticWorldMatrix(const FnKat::FnScenegraphIterator& iterator, const XFormState& xformState, double* pMatrix);
+
+	// sets the (possibly animated) xform of the location on the object
+	void applyTransform(const FnKat::FnScenegraphIterator& iterator, const XFormState& xformState, Imagine::Object* pObject,
+						bool allowMotionBlur = true);
+	// only for newly-created objects, as identity matrices are skipped
+	void setStaticTransform(const double* pMatrix, Imagine::Object* pObject);
+
+	void processLocationRecursive(const FnKat::FnScenegraphIterator& iterator, unsigned int currentDepth, const XFormState& parentXFormState);
 
-	void processGeometryPolymeshCompact(const FnKat::FnScenegraphIterator& iterator, bool asSubD);
+	void processGeometryPolymeshCompact(const FnKat::FnScenegraphIterator& iterator, const XFormState& xformState, bool asSubD);
 
-	void processSpecialisedType(const FnKat::FnScenegraphIterator& iterator, unsigned int currentDepth);
+	void processSpecialisedType(const FnKat::FnScenegraphIterator& iterator, const XFormState& xformState, unsigned int currentDepth);
 
 	Imagine::CompactGeometryInstance* createCompactGeometryInstanceFromLocation(const FnKat::FnScenegraphIterator& iterator, bool asSubD,
 																	   const FnKat::GroupAttribute& imagineStatements);
+	Imagine::CompactGeometryInstance* createCompactGeometryInstanceFromAttributes(const std::string& locationPath,
+																	   const FnKat::GroupAttribute& locationAttributes, bool asSubD,
+																	   const FnKat::GroupAttribute& imagineStatements);
 	Imagine::CompactGeometryInstance* createCompactGeometryInstanceFromLocationDiscard(const FnKat::FnScenegraphIterator& iterator, bool asSubD,
 																	   const FnKat::GroupAttribute& imagineStatements);
 
@@ -102,12 +150,12 @@ protected:
 												   unsigned int baseLevelDepth, unsigned int currentDepth);
 
 	InstanceInfo findOrBuildInstanceSourceItem(const FnKat::FnScenegraphIterator& iterator, const std::string& instanceSourcePath);
-	void processInstance(const FnKat::FnScenegraphIterator& iterator);
-	void processInstanceArray(const FnKat::FnScenegraphIterator& iterator);
+	void processInstance(const FnKat::FnScenegraphIterator& iterator, const XFormState& xformState);
+	void processInstanceArray(const FnKat::FnScenegraphIterator& iterator, const XFormState& xformState);
 	
-	void processSphere(const FnKat::FnScenegraphIterator& iterator);
+	void processSphere(const FnKat::FnScenegraphIterator& iterator, const XFormState& xformState);
 
-	void processLight(const FnKat::FnScenegraphIterator& iterator);
+	void processLight(const FnKat::FnScenegraphIterator& iterator, const XFormState& xformState);
 
 	static unsigned char getRenderVisibilityFlags(const FnKat::GroupAttribute& imagineStatements);
 	static void processVisibilityAttributes(const FnKat::GroupAttribute& imagineStatements, Imagine::Object* pObject);
@@ -115,6 +163,9 @@ protected:
 	unsigned int processUVs(FnKat::FloatConstVector& uvlist, std::vector<Imagine::UV>& aUVs);
 	
 	unsigned int sendObjectID(const FnKat::FnScenegraphIterator& iterator);
+	unsigned int sendObjectID(const std::string& location);
+
+	Imagine::Material* getLiveMaterial(const FnKat::GroupAttribute& locationAttributes, const FnKat::GroupAttribute& imagineStatements);
 	
 	unsigned int getCustomGeoFlags();
 	
@@ -133,8 +184,13 @@ protected:
 	LightHelpers				m_lightHelper;
 
 	std::map<std::string, InstanceInfo>	m_aInstances;
+
+	ExpansionProfiler			m_profiler;
 	
 	IDState*					m_pIDState; // we don't own this, and it's optional
+
+	// geometry instances created by live edits, which we own - object -> its current one
+	std::map<const Imagine::Object*, Imagine::CompactGeometryInstance*>	m_aLiveGeometryInstances;
 	
 	bool						m_isLiveRender;
 };
@@ -0,0 +1,181 @@
+/*
+ ImagineKatana
+ Copyright 2014-2019 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#include "shared_texture_budget.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// per-user, so different users' renders on a shared machine don't interfere with each other's permissions
+static const char* kSegmentNamePrefix = "/imagineKatanaTextureBudget_";
+
+SharedTextureBudget::SharedTextureBudget() : m_pSegment(NULL), m_slotIndex(-1)
+{
+}
+
+SharedTextureBudget::~SharedTextureBudget()
+{
+	release();
+
+	if (m_pSegment)
+	{
+		munmap(m_pSegment, sizeof(SharedSegment));
+		m_pSegment = NULL;
+	}
+}
+
+bool SharedTextureBudget::openSegment()
+{
+	if (m_pSegment)
+		return true;
+
+	char szSegmentName[64];
+	sprintf(szSegmentName, "%s%u", kSegmentNamePrefix, (unsigned int)getuid());
+
+	int fileHandle = shm_open(szSegmentName, O_RDWR | O_CREAT, 0600);
+	if (fileHandle == -1)
+		return false;
+
+	// new segments are zero-filled, which means all slots are free. If several processes do this at once,
+	// they all set the same size, so it doesn't matter.
+	if (ftruncate(fileHandle, sizeof(SharedSegment)) != 0)
+	{
+		close(fileHandle);
+		return false;
+	}
+
+	void* pMapping = mmap(NULL, sizeof(SharedSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fileHandle, 0);
+	close(fileHandle);
+
+	if (pMapping == MAP_FAILED)
+		return false;
+
+	m_pSegment = static_cast<SharedSegment*>(pMapping);
+
+	return true;
+}
+
+unsigned int SharedTextureBudget::acquire()
+{
+	if (!openSegment())
+		return 0;
+
+	// in case this is being called again
+	release();
+
+	int32_t ourPID = (int32_t)getpid();
+
+	unsigned int numActive = 0;
+
+	for (unsigned int i = 0; i < kMaxSlots; i++)
+	{
+		std::atomic<int32_t>& slot = m_pSegment->slots[i];
+		int32_t slotPID = reclaimDeadSlot(slot, ourPID);
+
+		if (slotPID == 0 && m_slotIndex == -1)
+		{
+			int32_t expected = 0;
+			if (slot.compare_exchange_strong(expected, ourPID))
+			{
+				m_slotIndex = (int)i;
+				numActive++;
+				continue;
+			}
+
+			slotPID = expected;
+		}
+
+		if (slotPID != 0)
+		{
+			numActive++;
+		}
+	}
+
+	// if all the slots were taken, we still count ourselves
+	if (m_slotIndex == -1)
+	{
+		numActive++;
+	}
+
+	return numActive;
+}
+
+unsigned int SharedTextureBudget::countActiveRenders()
+{
+	if (!m_pSegment)
+		return 0;
+
+	int32_t ourPID = (int32_t)getpid();
+
+	unsigned int numActive = 0;
+
+	for (unsigned int i = 0; i < kMaxSlots; i++)
+	{
+		if (reclaimDeadSlot(m_pSegment->slots[i], ourPID) != 0)
+		{
+			numActive++;
+		}
+	}
+
+	// if all the slots were taken when we acquired, we still count ourselves
+	if (m_slotIndex == -1)
+	{
+		numActive++;
+	}
+
+	return numActive;
+}
+
+int32_t SharedTextureBudget::reclaimDeadSlot(std::atomic<int32_t>& slot, int32_t ourPID)
+{
+	int32_t slotPID = slot.load();
+
+	if (slotPID != 0 && slotPID != ourPID && kill(slotPID, 0) == -1 && errno == ESRCH)
+	{
+		// process has gone away without releasing the slot (most likely it crashed or was killed), so reclaim it
+		if (slot.compare_exchange_strong(slotPID, 0))
+		{
+			slotPID = 0;
+		}
+	}
+
+	return slotPID;
+}
+
+void SharedTextureBudget::release()
+{
+	if (!m_pSegment || m_slotIndex == -1)
+		return;
+
+	int32_t ourPID = (int32_t)getpid();
+	m_pSegment->slots[m_slotIndex].compare_exchange_strong(ourPID, 0);
+	m_slotIndex = -1;
+}
+
+unsigned int SharedTextureBudget::calculateShare(unsigned int totalBudgetMB, unsigned int numActiveRenders)
+{
+	if (numActiveRenders <= 1)
+		return totalBudgetMB;
+
+	return totalBudgetMB / numActiveRenders;
+}
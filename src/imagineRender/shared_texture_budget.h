@@ -0,0 +1,70 @@
+/*
+ ImagineKatana
+ Copyright 2014-2019 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#ifndef SHARED_TEXTURE_BUDGET_H
+#define SHARED_TEXTURE_BUDGET_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Optional texture cache memory budget shared between concurrent renderboot processes on the same machine, so that
+// several renders running at once don't each assume they have the full 'texture_cache_max_size' to themselves.
+// Each render claims a slot (containing its PID) in a small POSIX shared memory segment using CAS, and slots of
+// processes which have died without releasing them are reclaimed. The budget is split evenly between the renders
+// which are active, and renders re-check how many others are active while they're running (see countActiveRenders()),
+// so that earlier renders shrink their share as more start, and grow it again as others finish.
+
+class SharedTextureBudget
+{
+public:
+	SharedTextureBudget();
+	~SharedTextureBudget();
+
+	// returns the number of renders (including this one) currently active, or 0 if the segment couldn't be used
+	unsigned int acquire();
+	void release();
+
+	// as above, but without claiming a slot (reclaiming slots of dead processes), so can be called periodically
+	// after acquire() to see if the share needs changing. Returns 0 if acquire() hasn't been called.
+	unsigned int countActiveRenders();
+
+	// works out this render's share of the total budget. This isn't floored to any minimum, so that the total across
+	// all renders stays within the budget - shares below kLowShareMB are likely to cause thrashing though.
+	static unsigned int calculateShare(unsigned int totalBudgetMB, unsigned int numActiveRenders);
+
+	static const unsigned int kLowShareMB = 256;
+
+protected:
+	static const unsigned int kMaxSlots = 64;
+
+	// reclaims the slot if the process using it has died, returning the slot's PID afterwards
+	static int32_t reclaimDeadSlot(std::atomic<int32_t>& slot, int32_t ourPID);
+
+	struct SharedSegment
+	{
+		std::atomic<int32_t>	slots[kMaxSlots]; // 0 == free, otherwise the PID of the render using it
+	};
+
+	bool openSegment();
+
+protected:
+	SharedSegment*		m_pSegment;
+	int					m_slotIndex;
+};
+
+#endif // SHARED_TEXTURE_BUDGET_H
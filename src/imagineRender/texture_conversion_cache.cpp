@@ -0,0 +1,484 @@
+/*
+ ImagineKatana
+ Copyright 2014-2019 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#include "texture_conversion_cache.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <ImfInputFile.h>
+#include <ImfTiledOutputFile.h>
+#include <ImfHeader.h>
+#include <ImfChannelList.h>
+#include <ImfFrameBuffer.h>
+#include <ImfTileDescription.h>
+#include <ImfPartType.h>
+
+#include "utils/file_helpers.h"
+#include "utils/logger.h"
+
+using namespace Imagine;
+
+static const int kConvertedTileSize = 64;
+
+// FNV-1a, so the cache filenames are stable between processes / versions
+static uint64_t hashBytes(uint64_t hash, const void* pData, size_t length)
+{
+	const unsigned char* pBytes = (const unsigned char*)pData;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= pBytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+struct ConversionChannel
+{
+	std::string		name;
+	bool			isUInt;
+};
+
+// a tile row's worth of scanlines of one mipmap level
+struct LevelStrip
+{
+	LevelStrip() : width(0), height(0), startY(0), numRows(0)
+	{
+	}
+
+	int					width;
+	int					height;
+	int					startY; // first row of the level in the strip
+	int					numRows;
+
+	// per channel - only the one for the channel's type is used
+	std::vector<std::vector<float> >		aFloatValues;
+	std::vector<std::vector<unsigned int> >	aUIntValues;
+};
+
+static void setStripFrameBuffer(Imf::FrameBuffer& frameBuffer, const std::vector<ConversionChannel>& aChannels, LevelStrip& strip,
+								const Imath::V2i& origin)
+{
+	// each level's data window has the same origin as the full-res one, and the strip's first row is at startY within it
+	long originOffset = (long)origin.x + ((long)origin.y + (long)strip.startY) * (long)strip.width;
+
+	for (size_t i = 0; i < aChannels.size(); i++)
+	{
+		const ConversionChannel& channel = aChannels[i];
+		if (channel.isUInt)
+		{
+			frameBuffer.insert(channel.name.c_str(), Imf::Slice(Imf::UINT, (char*)(&strip.aUIntValues[i][0] - originOffset),
+																sizeof(unsigned int), sizeof(unsigned int) * strip.width));
+		}
+		else
+		{
+			frameBuffer.insert(channel.name.c_str(), Imf::Slice(Imf::FLOAT, (char*)(&strip.aFloatValues[i][0] - originOffset),
+																sizeof(float), sizeof(float) * strip.width));
+		}
+	}
+}
+
+// writes out the level's current strip as a row of tiles, then filters it down into the next level's strip,
+// writing that out in turn when it fills up
+static void writeLevelStrip(Imf::TiledOutputFile& outputFile, const std::vector<ConversionChannel>& aChannels, std::vector<LevelStrip>& aStrips,
+							int level, const Imath::V2i& origin)
+{
+	LevelStrip& strip = aStrips[level];
+
+	Imf::FrameBuffer frameBuffer;
+	setStripFrameBuffer(frameBuffer, aChannels, strip, origin);
+
+	int tileRow = strip.startY / kConvertedTileSize;
+	outputFile.setFrameBuffer(frameBuffer);
+	outputFile.writeTiles(0, outputFile.numXTiles(level) - 1, tileRow, tileRow, level);
+
+	if (level + 1 >= (int)aStrips.size())
+		return;
+
+	LevelStrip& nextStrip = aStrips[level + 1];
+
+	// rows of the next level this strip covers. Levels are rounded down, so a last odd row gets dropped, apart from
+	// when the level's a single row high
+	int stripEndY = strip.startY + strip.numRows;
+	int nextStartRow = strip.startY / 2;
+	int nextEndRow = (stripEndY == strip.height) ? nextStrip.height : stripEndY / 2;
+
+	for (int row = nextStartRow; row < nextEndRow; row++)
+	{
+		if (row % kConvertedTileSize == 0)
+		{
+			nextStrip.startY = row;
+			nextStrip.numRows = 0;
+		}
+
+		int srcY0 = row * 2 - strip.startY;
+		int srcY1 = std::min(row * 2 + 1, strip.height - 1) - strip.startY;
+		int dstY = row - nextStrip.startY;
+
+		// simple box filter - UINT channels are generally IDs, so those just get point-sampled instead
+		for (size_t i = 0; i < aChannels.size(); i++)
+		{
+			for (int x = 0; x < nextStrip.width; x++)
+			{
+				int srcX0 = std::min(x * 2, strip.width - 1);
+				int srcX1 = std::min(x * 2 + 1, strip.width - 1);
+
+				if (aChannels[i].isUInt)
+				{
+					nextStrip.aUIntValues[i][dstY * nextStrip.width + x] = strip.aUIntValues[i][srcY0 * strip.width + srcX0];
+				}
+				else
+				{
+					const std::vector<float>& aValues = strip.aFloatValues[i];
+					nextStrip.aFloatValues[i][dstY * nextStrip.width + x] = (aValues[srcY0 * strip.width + srcX0] + aValues[srcY0 * strip.width + srcX1] +
+																			  aValues[srcY1 * strip.width + srcX0] + aValues[srcY1 * strip.width + srcX1]) * 0.25f;
+				}
+			}
+		}
+
+		nextStrip.numRows++;
+
+		if (nextStrip.numRows == kConvertedTileSize || row == nextStrip.height - 1)
+		{
+			writeLevelStrip(outputFile, aChannels, aStrips, level + 1, origin);
+		}
+	}
+}
+
+TextureConversionCache::TextureConversionCache() : m_pLogger(NULL), m_pThread(NULL), m_threadActive(false), m_abort(false)
+{
+}
+
+TextureConversionCache::~TextureConversionCache()
+{
+	waitForConversions(false);
+}
+
+void TextureConversionCache::setCachePath(const std::string& cachePath, Logger* pLogger)
+{
+	m_pLogger = pLogger;
+	m_cachePath = cachePath;
+
+	if (m_cachePath.empty())
+		return;
+
+	if (m_cachePath[m_cachePath.size() - 1] == '/')
+	{
+		m_cachePath = m_cachePath.substr(0, m_cachePath.size() - 1);
+	}
+
+	if (!FileHelpers::doesDirectoryExist(m_cachePath) && mkdir(m_cachePath.c_str(), 0775) != 0)
+	{
+		if (m_pLogger)
+		{
+			m_pLogger->warning("Couldn't create texture conversion cache directory: %s - disabling texture conversion.", m_cachePath.c_str());
+		}
+		m_cachePath = "";
+	}
+}
+
+std::string TextureConversionCache::resolveTexture(const std::string& path)
+{
+	if (m_cachePath.empty())
+		return path;
+
+	std::string extension = FileHelpers::getFileExtension(path);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	// we can only do EXRs currently
+	if (extension != "exr")
+		return path;
+
+	struct stat sourceStat;
+	if (stat(path.c_str(), &sourceStat) != 0)
+		return path;
+
+	uint64_t hash = 14695981039346656037ULL;
+	hash = hashBytes(hash, path.c_str(), path.size());
+	int64_t modifiedTime = (int64_t)sourceStat.st_mtime;
+	int64_t fileSize = (int64_t)sourceStat.st_size;
+	hash = hashBytes(hash, &modifiedTime, sizeof(int64_t));
+	hash = hashBytes(hash, &fileSize, sizeof(int64_t));
+
+	// keep the original filename in there to make it easier to see what's what
+	std::string stem = path;
+	size_t separatorPos = stem.rfind('/');
+	if (separatorPos != std::string::npos)
+	{
+		stem = stem.substr(separatorPos + 1);
+	}
+	stem = stem.substr(0, stem.rfind('.'));
+
+	char szHash[32];
+	sprintf(szHash, "_%016llx", (unsigned long long)hash);
+
+	std::string cacheBasePath = m_cachePath + "/" + stem + szHash;
+	std::string convertedPath = cacheBasePath + ".exr";
+	std::string skipMarkerPath = cacheBasePath + ".skip";
+
+	struct stat convertedStat;
+	if (stat(convertedPath.c_str(), &convertedStat) == 0)
+		return convertedPath;
+
+	// we've already found it doesn't need converting
+	if (stat(skipMarkerPath.c_str(), &convertedStat) == 0)
+		return path;
+
+	m_queueLock.lock();
+
+	if (m_queuedPaths.find(path) == m_queuedPaths.end())
+	{
+		m_queuedPaths.insert(path);
+		m_aQueue.push_back(ConversionItem(path, convertedPath, skipMarkerPath));
+
+		if (!m_threadActive)
+		{
+			// any previous thread has finished with the queue, and is just exiting, so can be cleaned up
+			if (m_pThread)
+			{
+				m_pThread->waitForCompletion();
+				delete m_pThread;
+			}
+
+			m_abort = false;
+			m_threadActive = true;
+
+			m_pThread = new ConversionThread(this);
+			m_pThread->start();
+		}
+	}
+
+	m_queueLock.unlock();
+
+	return path;
+}
+
+void TextureConversionCache::waitForConversions(bool finishQueued)
+{
+	m_queueLock.lock();
+
+	if (finishQueued)
+	{
+		if (!m_aQueue.empty() && m_pLogger)
+		{
+			m_pLogger->info("Waiting for %u queued texture conversions to complete...", (unsigned int)m_aQueue.size());
+		}
+	}
+	else
+	{
+		// anything not done will get queued again next time
+		m_aQueue.clear();
+		m_queuedPaths.clear();
+		m_abort = true;
+	}
+
+	ConversionThread* pThread = m_pThread;
+	m_pThread = NULL;
+
+	m_queueLock.unlock();
+
+	if (pThread)
+	{
+		pThread->waitForCompletion();
+		delete pThread;
+	}
+}
+
+void TextureConversionCache::processQueue()
+{
+	while (true)
+	{
+		m_queueLock.lock();
+
+		if (m_aQueue.empty())
+		{
+			m_threadActive = false;
+			m_queueLock.unlock();
+			return;
+		}
+
+		ConversionItem item = m_aQueue.front();
+		m_aQueue.pop_front();
+
+		m_queueLock.unlock();
+
+		if (!needsConversion(item.sourcePath))
+		{
+			writeSkipMarker(item.skipMarkerPath);
+			continue;
+		}
+
+		// write to a temp file and rename it once done, so that other processes never see partially-written files
+		char szTempSuffix[32];
+		sprintf(szTempSuffix, ".tmp%d", (int)getpid());
+		std::string tempPath = item.convertedPath + szTempSuffix;
+
+		try
+		{
+			if (!convertTexture(item, tempPath))
+			{
+				unlink(tempPath.c_str());
+				// unless we gave up part-way through, it's never going to work for this version of the file
+				if (!m_abort)
+				{
+					writeSkipMarker(item.skipMarkerPath);
+				}
+			}
+			else if (rename(tempPath.c_str(), item.convertedPath.c_str()) != 0)
+			{
+				unlink(tempPath.c_str());
+			}
+			else if (m_pLogger)
+			{
+				m_pLogger->info("Converted texture: %s to tiled mipmapped texture: %s", item.sourcePath.c_str(), item.convertedPath.c_str());
+			}
+		}
+		catch (const std::exception& e)
+		{
+			if (m_pLogger)
+			{
+				m_pLogger->warning("Couldn't convert texture: %s - %s", item.sourcePath.c_str(), e.what());
+			}
+			unlink(tempPath.c_str());
+		}
+	}
+}
+
+bool TextureConversionCache::needsConversion(const std::string& path)
+{
+	try
+	{
+		Imf::InputFile file(path.c_str());
+		const Imf::Header& header = file.header();
+
+		if (!header.hasTileDescription())
+			return true;
+
+		return header.tileDescription().mode == Imf::ONE_LEVEL;
+	}
+	catch (...)
+	{
+		// nothing we can do with it
+		return false;
+	}
+}
+
+void TextureConversionCache::writeSkipMarker(const std::string& markerPath)
+{
+	FILE* pFile = fopen(markerPath.c_str(), "w");
+	if (pFile)
+	{
+		fclose(pFile);
+	}
+}
+
+bool TextureConversionCache::convertTexture(const ConversionItem& item, const std::string& tempPath)
+{
+	Imf::InputFile inputFile(item.sourcePath.c_str());
+
+	// the output keeps all the source header's attributes (data / display windows, channel types, etc), with just
+	// the tiling and compression changed
+	Imf::Header header = inputFile.header();
+
+	const Imath::Box2i& dataWindow = header.dataWindow();
+	int height = dataWindow.max.y - dataWindow.min.y + 1;
+
+	std::vector<ConversionChannel> aChannels;
+
+	const Imf::ChannelList& channels = header.channels();
+	for (Imf::ChannelList::ConstIterator itChannel = channels.begin(); itChannel != channels.end(); ++itChannel)
+	{
+		const Imf::Channel& channel = itChannel.channel();
+		if (channel.xSampling != 1 || channel.ySampling != 1)
+		{
+			// sub-sampled channels can't be tiled
+			return false;
+		}
+
+		ConversionChannel conversionChannel;
+		conversionChannel.name = itChannel.name();
+		conversionChannel.isUInt = (channel.type == Imf::UINT);
+		aChannels.push_back(conversionChannel);
+	}
+
+	if (aChannels.empty())
+		return false;
+
+	header.setTileDescription(Imf::TileDescription(kConvertedTileSize, kConvertedTileSize, Imf::MIPMAP_LEVELS, Imf::ROUND_DOWN));
+	header.compression() = Imf::ZIP_COMPRESSION;
+	// the levels get written interleaved as their strips fill up, which with INCREASING_Y would make OpenEXR
+	// buffer all the lower levels' tiles in memory until the top level was finished
+	header.lineOrder() = Imf::RANDOM_Y;
+	if (header.hasType())
+	{
+		header.setType(Imf::TILEDIMAGE);
+	}
+
+	Imf::TiledOutputFile outputFile(tempPath.c_str(), header);
+
+	// only one tile row of each level is in memory at once, so large textures don't need the whole image
+	// (as well as the lower levels) in memory to be converted
+	std::vector<LevelStrip> aStrips(outputFile.numLevels());
+	for (int level = 0; level < outputFile.numLevels(); level++)
+	{
+		LevelStrip& strip = aStrips[level];
+		strip.width = outputFile.levelWidth(level);
+		strip.height = outputFile.levelHeight(level);
+
+		size_t stripSize = (size_t)strip.width * (size_t)kConvertedTileSize;
+		strip.aFloatValues.resize(aChannels.size());
+		strip.aUIntValues.resize(aChannels.size());
+		for (size_t i = 0; i < aChannels.size(); i++)
+		{
+			if (aChannels[i].isUInt)
+			{
+				strip.aUIntValues[i].resize(stripSize);
+			}
+			else
+			{
+				strip.aFloatValues[i].resize(stripSize);
+			}
+		}
+	}
+
+	// all channels are read as either FLOAT or UINT (lossless for HALF and FLOAT), and converted back to their
+	// original types by OpenEXR on writing
+	LevelStrip& topStrip = aStrips[0];
+	for (int y = 0; y < height; y += kConvertedTileSize)
+	{
+		if (m_abort)
+			return false;
+
+		topStrip.startY = y;
+		topStrip.numRows = std::min(kConvertedTileSize, height - y);
+
+		Imf::FrameBuffer frameBuffer;
+		setStripFrameBuffer(frameBuffer, aChannels, topStrip, dataWindow.min);
+
+		inputFile.setFrameBuffer(frameBuffer);
+		inputFile.readPixels(dataWindow.min.y + y, dataWindow.min.y + y + topStrip.numRows - 1);
+
+		writeLevelStrip(outputFile, aChannels, aStrips, 0, dataWindow.min);
+	}
+
+	return true;
+}
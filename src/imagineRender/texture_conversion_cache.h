@@ -0,0 +1,117 @@
+/*
+ ImagineKatana
+ Copyright 2014-2019 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#ifndef TEXTURE_CONVERSION_CACHE_H
+#define TEXTURE_CONVERSION_CACHE_H
+
+#include <string>
+#include <set>
+#include <deque>
+#include <atomic>
+
+#include "utils/threads/mutex.h"
+#include "utils/threads/thread.h"
+
+namespace Imagine
+{
+	class Logger;
+}
+
+// Local disk cache of derived textures: scanline (or tiled but non-mipmapped) EXR textures get converted in a
+// background thread to tiled, mipmapped EXRs, keyed by the source path, modification time and size, so that
+// subsequent renders can use the converted version directly with the texture cache, rather than having to
+// read the entire image in. Textures which don't need converting (or can't be) get an empty marker file
+// written instead, so they aren't re-checked by every render.
+
+class TextureConversionCache
+{
+public:
+	TextureConversionCache();
+	~TextureConversionCache();
+
+	// an empty path disables it
+	void setCachePath(const std::string& cachePath, Imagine::Logger* pLogger);
+
+	bool isEnabled() const
+	{
+		return !m_cachePath.empty();
+	}
+
+	// returns the path of the converted texture if it exists already, otherwise queues the texture for conversion
+	// (if it needs it) and returns the original path.
+	std::string resolveTexture(const std::string& path);
+
+	// waits for any queued conversions to complete if finishQueued is true, otherwise abandons the queue and
+	// aborts the current conversion as soon as possible
+	void waitForConversions(bool finishQueued);
+
+protected:
+	struct ConversionItem
+	{
+		ConversionItem(const std::string& src, const std::string& dst, const std::string& marker) : sourcePath(src), convertedPath(dst),
+			skipMarkerPath(marker)
+		{
+		}
+
+		std::string		sourcePath;
+		std::string		convertedPath;
+		std::string		skipMarkerPath;
+	};
+
+	class ConversionThread : public Imagine::Thread
+	{
+	public:
+		ConversionThread(TextureConversionCache* pCache) : m_pCache(pCache)
+		{
+		}
+
+		virtual void run()
+		{
+			m_pCache->processQueue();
+		}
+
+	protected:
+		TextureConversionCache*		m_pCache;
+	};
+
+	// converts queued textures until the queue's empty
+	void processQueue();
+
+	// returns false if the texture can't be converted, and throws for other errors
+	bool convertTexture(const ConversionItem& item, const std::string& tempPath);
+
+	static bool needsConversion(const std::string& path);
+	static void writeSkipMarker(const std::string& markerPath);
+
+protected:
+	std::string						m_cachePath;
+	Imagine::Logger*				m_pLogger;
+
+	ConversionThread*				m_pThread;
+	Imagine::Mutex					m_queueLock;
+	std::deque<ConversionItem>		m_aQueue;
+	// so we don't queue things more than once per process
+	std::set<std::string>			m_queuedPaths;
+	// protected by m_queueLock - true from when a thread is started until it finds the queue empty, so new items
+	// either get picked up by the running thread, or start a new one
+	bool							m_threadActive;
+	// checked during conversions, so that waitForConversions(false) doesn't have to wait for a large one to finish
+	std::atomic<bool>				m_abort;
+};
+
+#endif // TEXTURE_CONVERSION_CACHE_H
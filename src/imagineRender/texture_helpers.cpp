@@ -0,0 +1,679 @@
+/*
+ ImagineKatana
+ Copyright 2014-2019 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#include "texture_helpers.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include <ImfInputFile.h>
+#include <ImfHeader.h>
+#include <ImfChannelList.h>
+#include <ImfTileDescription.h>
+
+#ifdef HAVE_TIFF_SUPPORT
+#include <tiffio.h>
+#endif
+
+#include "utils/file_helpers.h"
+#include "utils/logger.h"
+#include "utils/string_helpers.h"
+
+using namespace Imagine;
+
+TextureRegistry& TextureRegistry::instance()
+{
+	static TextureRegistry registry;
+	return registry;
+}
+
+std::string TextureRegistry::registerTexture(const std::string& path, const char* usage)
+{
+	if (path.empty())
+		return path;
+
+	m_lock.lock();
+
+	std::map<std::string, TextureEntry>::iterator itFind = m_textures.find(path);
+	if (itFind != m_textures.end())
+	{
+		TextureEntry& entry = (*itFind).second;
+		entry.usages.insert(usage);
+		std::string resolvedPath = entry.resolvedPath;
+
+		m_lock.unlock();
+
+		return resolvedPath;
+	}
+
+	m_lock.unlock();
+
+	// resolving might involve file system access, so do it without the lock held. If two threads do this for the
+	// same path at the same time, they'll get the same result...
+	std::string resolvedPath;
+	std::vector<std::string> aTilePaths;
+	if (UDIMHelpers::isUDIMPath(path))
+	{
+		// converted textures are keyed per file, so UDIM tiles can't go through the conversion cache as a set
+		resolvedPath = UDIMHelpers::normaliseUDIMPath(path);
+		UDIMHelpers::getUDIMTilePaths(resolvedPath, aTilePaths);
+	}
+	else
+	{
+		resolvedPath = m_conversionCache.resolveTexture(path);
+	}
+
+	m_lock.lock();
+
+	TextureEntry& entry = m_textures[path];
+	entry.resolvedPath = resolvedPath;
+	entry.usages.insert(usage);
+	entry.aTilePaths.swap(aTilePaths);
+
+	m_lock.unlock();
+
+	return resolvedPath;
+}
+
+void TextureRegistry::getTexturePaths(std::vector<std::string>& aPaths, bool resolved) const
+{
+	m_lock.lock();
+
+	aPaths.reserve(aPaths.size() + m_textures.size());
+
+	std::map<std::string, TextureEntry>::const_iterator itTexture = m_textures.begin();
+	for (; itTexture != m_textures.end(); ++itTexture)
+	{
+		const TextureEntry& entry = (*itTexture).second;
+		if (!resolved)
+		{
+			aPaths.push_back((*itTexture).first);
+		}
+		else if (!entry.aTilePaths.empty())
+		{
+			aPaths.insert(aPaths.end(), entry.aTilePaths.begin(), entry.aTilePaths.end());
+		}
+		else
+		{
+			// for UDIMs with no tiles, this will get reported as missing
+			aPaths.push_back(entry.resolvedPath);
+		}
+	}
+
+	m_lock.unlock();
+}
+
+void TextureRegistry::getTextureUsages(const std::string& path, std::vector<std::string>& aUsages) const
+{
+	m_lock.lock();
+
+	std::map<std::string, TextureEntry>::const_iterator itFind = m_textures.find(path);
+	if (itFind != m_textures.end())
+	{
+		const std::set<std::string>& usages = (*itFind).second.usages;
+		aUsages.insert(aUsages.end(), usages.begin(), usages.end());
+	}
+
+	m_lock.unlock();
+}
+
+size_t TextureRegistry::getTextureCount() const
+{
+	m_lock.lock();
+
+	size_t count = m_textures.size();
+
+	m_lock.unlock();
+
+	return count;
+}
+
+void TextureRegistry::clear()
+{
+	m_lock.lock();
+
+	m_textures.clear();
+
+	m_lock.unlock();
+}
+
+//
+
+static const char* kUDIMToken = "<UDIM>";
+static const char* kMariUDIMToken = "_MAPID_";
+
+bool UDIMHelpers::isUDIMPath(const std::string& path)
+{
+	return path.find(kUDIMToken) != std::string::npos || path.find("<udim>") != std::string::npos ||
+			path.find(kMariUDIMToken) != std::string::npos;
+}
+
+std::string UDIMHelpers::normaliseUDIMPath(const std::string& path)
+{
+	std::string normalisedPath = path;
+
+	const char* aTokens[2] = { "<udim>", kMariUDIMToken };
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		std::string token = aTokens[i];
+		size_t tokenPos = 0;
+		while ((tokenPos = normalisedPath.find(token, tokenPos)) != std::string::npos)
+		{
+			normalisedPath.replace(tokenPos, token.size(), kUDIMToken);
+			tokenPos += strlen(kUDIMToken);
+		}
+	}
+
+	return normalisedPath;
+}
+
+void UDIMHelpers::getUDIMTilePaths(const std::string& normalisedPath, std::vector<std::string>& aTilePaths)
+{
+	size_t tokenPos = normalisedPath.find(kUDIMToken);
+	size_t separatorPos = normalisedPath.rfind('/');
+	// we only support the token in the filename itself
+	if (tokenPos == std::string::npos || (separatorPos != std::string::npos && separatorPos > tokenPos))
+		return;
+
+	std::string directory = (separatorPos == std::string::npos) ? "." : normalisedPath.substr(0, separatorPos);
+	size_t filenameStart = (separatorPos == std::string::npos) ? 0 : separatorPos + 1;
+	std::string prefix = normalisedPath.substr(filenameStart, tokenPos - filenameStart);
+	std::string suffix = normalisedPath.substr(tokenPos + strlen(kUDIMToken));
+
+	DIR* pDir = opendir(directory.c_str());
+	if (!pDir)
+		return;
+
+	struct dirent* pEntry = NULL;
+	while ((pEntry = readdir(pDir)) != NULL)
+	{
+		std::string filename = pEntry->d_name;
+		// UDIM tile numbers are always four digits (1001 - 9999)
+		if (filename.size() != prefix.size() + 4 + suffix.size())
+			continue;
+
+		if (filename.compare(0, prefix.size(), prefix) != 0 || filename.compare(prefix.size() + 4, suffix.size(), suffix) != 0)
+			continue;
+
+		bool validNumber = true;
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			if (!isdigit(filename[prefix.size() + i]))
+			{
+				validNumber = false;
+				break;
+			}
+		}
+
+		if (!validNumber || atoi(filename.substr(prefix.size(), 4).c_str()) < 1001)
+			continue;
+
+		aTilePaths.push_back(normalisedPath.substr(0, filenameStart) + filename);
+	}
+
+	closedir(pDir);
+
+	std::sort(aTilePaths.begin(), aTilePaths.end());
+}
+
+//
+
+size_t TextureFileInfo::getEstimatedMemorySize() const
+{
+	size_t fullResSize = (size_t)width * (size_t)height * (size_t)channels * (size_t)bytesPerChannel;
+
+	// full mipmap chain adds roughly a third on top of the base level
+	if (mipmapped)
+	{
+		fullResSize += fullResSize / 3;
+	}
+
+	return fullResSize;
+}
+
+const char* TextureFileInfo::getFormatName() const
+{
+	switch (format)
+	{
+		case eFormatEXR:
+			return "exr";
+		case eFormatTIFF:
+			return "tiff";
+		case eFormatOther:
+			return "other";
+		default:
+			return "unknown";
+	}
+}
+
+//
+
+TexturePreflight::TexturePreflight(Logger& logger) : m_logger(logger), m_nextIndex(0)
+{
+	// check the files which will actually be used
+	std::vector<std::string> aPaths;
+	TextureRegistry::instance().getTexturePaths(aPaths, true);
+
+	m_aTextures.reserve(aPaths.size());
+
+	std::vector<std::string>::const_iterator itPath = aPaths.begin();
+	for (; itPath != aPaths.end(); ++itPath)
+	{
+		m_aTextures.push_back(TextureFileInfo(*itPath));
+	}
+}
+
+void TexturePreflight::run(unsigned int numThreads)
+{
+	if (m_aTextures.empty())
+		return;
+
+	// this is almost entirely I/O latency bound (especially on network storage), so there's no point having more threads than textures...
+	numThreads = std::max(1u, std::min(numThreads, (unsigned int)m_aTextures.size()));
+
+	m_nextIndex = 0;
+
+	std::vector<std::thread> aThreads;
+	aThreads.reserve(numThreads);
+	for (unsigned int i = 0; i < numThreads; i++)
+	{
+		aThreads.push_back(std::thread(&TexturePreflight::workerThread, this));
+	}
+
+	std::vector<std::thread>::iterator itThread = aThreads.begin();
+	for (; itThread != aThreads.end(); ++itThread)
+	{
+		(*itThread).join();
+	}
+}
+
+void TexturePreflight::workerThread()
+{
+	while (true)
+	{
+		size_t index = m_nextIndex++;
+		if (index >= m_aTextures.size())
+			break;
+
+		readTextureHeader(m_aTextures[index]);
+	}
+}
+
+void TexturePreflight::readTextureHeader(TextureFileInfo& textureInfo)
+{
+	struct stat fileStat;
+	if (stat(textureInfo.path.c_str(), &fileStat) != 0)
+	{
+		textureInfo.exists = false;
+		textureInfo.error = "file does not exist";
+		return;
+	}
+
+	textureInfo.exists = true;
+	textureInfo.fileSize = (size_t)fileStat.st_size;
+	textureInfo.modifiedTime = fileStat.st_mtime;
+
+	std::string extension = FileHelpers::getFileExtension(textureInfo.path);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+	if (extension == "exr")
+	{
+		textureInfo.format = TextureFileInfo::eFormatEXR;
+		readEXRHeader(textureInfo);
+	}
+	else if (extension == "tif" || extension == "tiff" || extension == "tx")
+	{
+		textureInfo.format = TextureFileInfo::eFormatTIFF;
+#ifdef HAVE_TIFF_SUPPORT
+		readTIFFHeader(textureInfo);
+#else
+		textureInfo.error = "TIFF support not available";
+#endif
+	}
+	else
+	{
+		// we can't do anything clever with these, they always get read in full
+		textureInfo.format = TextureFileInfo::eFormatOther;
+		textureInfo.readable = true;
+	}
+}
+
+void TexturePreflight::readEXRHeader(TextureFileInfo& textureInfo)
+{
+	try
+	{
+		Imf::InputFile file(textureInfo.path.c_str());
+		const Imf::Header& header = file.header();
+
+		const Imath::Box2i& dataWindow = header.dataWindow();
+		textureInfo.width = dataWindow.max.x - dataWindow.min.x + 1;
+		textureInfo.height = dataWindow.max.y - dataWindow.min.y + 1;
+
+		const Imf::ChannelList& channels = header.channels();
+		for (Imf::ChannelList::ConstIterator itChannel = channels.begin(); itChannel != channels.end(); ++itChannel)
+		{
+			textureInfo.channels++;
+
+			unsigned int channelBytes = (itChannel.channel().type == Imf::HALF) ? 2 : 4;
+			textureInfo.bytesPerChannel = std::max(textureInfo.bytesPerChannel, channelBytes);
+		}
+
+		if (header.hasTileDescription())
+		{
+			const Imf::TileDescription& tileDesc = header.tileDescription();
+			textureInfo.tiled = true;
+			textureInfo.tileWidth = tileDesc.xSize;
+			textureInfo.tileHeight = tileDesc.ySize;
+			textureInfo.mipmapped = tileDesc.mode != Imf::ONE_LEVEL;
+
+			if (textureInfo.mipmapped)
+			{
+				unsigned int maxDim = std::max(textureInfo.width, textureInfo.height);
+				textureInfo.numMipLevels = 1;
+				while (maxDim > 1)
+				{
+					maxDim = (tileDesc.roundingMode == Imf::ROUND_UP) ? (maxDim + 1) / 2 : maxDim / 2;
+					textureInfo.numMipLevels++;
+				}
+			}
+		}
+
+		textureInfo.readable = true;
+	}
+	catch (const std::exception& e)
+	{
+		textureInfo.readable = false;
+		textureInfo.error = e.what();
+	}
+}
+
+#ifdef HAVE_TIFF_SUPPORT
+void TexturePreflight::readTIFFHeader(TextureFileInfo& textureInfo)
+{
+	TIFF* pTiff = TIFFOpen(textureInfo.path.c_str(), "r");
+	if (!pTiff)
+	{
+		textureInfo.readable = false;
+		textureInfo.error = "couldn't open file";
+		return;
+	}
+
+	uint32 width = 0;
+	uint32 height = 0;
+	uint16 samplesPerPixel = 1;
+	uint16 bitsPerSample = 8;
+
+	TIFFGetField(pTiff, TIFFTAG_IMAGEWIDTH, &width);
+	TIFFGetField(pTiff, TIFFTAG_IMAGELENGTH, &height);
+	TIFFGetFieldDefaulted(pTiff, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+	TIFFGetFieldDefaulted(pTiff, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+
+	textureInfo.width = width;
+	textureInfo.height = height;
+	textureInfo.channels = samplesPerPixel;
+	textureInfo.bytesPerChannel = std::max(1u, (unsigned int)bitsPerSample / 8);
+
+	if (TIFFIsTiled(pTiff))
+	{
+		uint32 tileWidth = 0;
+		uint32 tileHeight = 0;
+		TIFFGetField(pTiff, TIFFTAG_TILEWIDTH, &tileWidth);
+		TIFFGetField(pTiff, TIFFTAG_TILELENGTH, &tileHeight);
+
+		textureInfo.tiled = true;
+		textureInfo.tileWidth = tileWidth;
+		textureInfo.tileHeight = tileHeight;
+	}
+
+	// mipmap levels are stored as additional directories
+	textureInfo.numMipLevels = TIFFNumberOfDirectories(pTiff);
+	textureInfo.mipmapped = textureInfo.numMipLevels > 1;
+
+	textureInfo.readable = true;
+
+	TIFFClose(pTiff);
+}
+#endif
+
+void TexturePreflight::report(unsigned int cacheMemoryLimitMB, unsigned int cacheFileHandleLimit) const
+{
+	unsigned int numMissing = 0;
+	unsigned int numUnreadable = 0;
+	unsigned int numScanline = 0;
+	unsigned int numNonMipmapped = 0;
+	unsigned int numOther = 0;
+
+	size_t totalFileSize = 0;
+	size_t totalMemorySize = 0;
+	// size of the textures which will have to be read in full, regardless of the texture cache
+	size_t totalFullReadSize = 0;
+
+	std::vector<TextureFileInfo>::const_iterator itTexture = m_aTextures.begin();
+	for (; itTexture != m_aTextures.end(); ++itTexture)
+	{
+		const TextureFileInfo& textureInfo = *itTexture;
+
+		if (!textureInfo.exists)
+		{
+			m_logger.warning("Texture pre-flight: missing texture: %s", textureInfo.path.c_str());
+			numMissing++;
+			continue;
+		}
+
+		totalFileSize += textureInfo.fileSize;
+
+		if (!textureInfo.readable)
+		{
+			m_logger.warning("Texture pre-flight: couldn't read header of texture: %s (%s)", textureInfo.path.c_str(), textureInfo.error.c_str());
+			numUnreadable++;
+			continue;
+		}
+
+		totalMemorySize += textureInfo.getEstimatedMemorySize();
+
+		if (textureInfo.format == TextureFileInfo::eFormatOther)
+		{
+			m_logger.debug("Texture pre-flight: %s - non-tileable format, will be read in full.", textureInfo.path.c_str());
+			numOther++;
+			continue;
+		}
+
+		m_logger.debug("Texture pre-flight: %s - %s, %ux%u, %u channels, %u bytes per channel, %s, %u mipmap levels.", textureInfo.path.c_str(),
+					   textureInfo.getFormatName(), textureInfo.width, textureInfo.height, textureInfo.channels, textureInfo.bytesPerChannel,
+					   textureInfo.tiled ? "tiled" : "scanline", textureInfo.numMipLevels);
+
+		if (!textureInfo.tiled)
+		{
+			m_logger.warning("Texture pre-flight: texture is scanline (not tiled) and will be read in full: %s (%ux%u)", textureInfo.path.c_str(),
+							 textureInfo.width, textureInfo.height);
+			numScanline++;
+			totalFullReadSize += textureInfo.getEstimatedMemorySize();
+		}
+		else if (!textureInfo.mipmapped)
+		{
+			m_logger.warning("Texture pre-flight: texture is tiled but has no mipmaps: %s (%ux%u)", textureInfo.path.c_str(),
+							 textureInfo.width, textureInfo.height);
+			numNonMipmapped++;
+		}
+	}
+
+	std::string fileSizeString = formatSize(totalFileSize);
+	std::string memorySizeString = formatSize(totalMemorySize);
+
+	m_logger.info("Texture pre-flight: %u textures, %s on disk, %s estimated if fully loaded.", (unsigned int)m_aTextures.size(),
+				  fileSizeString.c_str(), memorySizeString.c_str());
+
+	if (numMissing > 0 || numUnreadable > 0 || numScanline > 0 || numNonMipmapped > 0)
+	{
+		m_logger.warning("Texture pre-flight: %u missing, %u unreadable, %u scanline, %u tiled without mipmaps, %u non-tileable format.",
+						 numMissing, numUnreadable, numScanline, numNonMipmapped, numOther);
+	}
+
+	if (numScanline > 0)
+	{
+		std::string fullReadSizeString = formatSize(totalFullReadSize);
+		m_logger.warning("Texture pre-flight: scanline textures will need %s of memory outside of the texture cache's control.", fullReadSizeString.c_str());
+	}
+
+	if (cacheFileHandleLimit > 0 && m_aTextures.size() > cacheFileHandleLimit)
+	{
+		m_logger.warning("Texture pre-flight: number of textures (%u) is greater than the texture cache file handle limit (%u) - "
+						 "consider increasing 'texture_cache_max_file_handles' to avoid file handle thrashing.",
+						 (unsigned int)m_aTextures.size(), cacheFileHandleLimit);
+	}
+
+	size_t cacheMemoryLimit = (size_t)cacheMemoryLimitMB * 1024 * 1024;
+	if (cacheMemoryLimit > 0 && totalMemorySize > cacheMemoryLimit)
+	{
+		m_logger.info("Texture pre-flight: total texture size is greater than the texture cache memory limit (%u MB), so tiles may be evicted and re-read.",
+					  cacheMemoryLimitMB);
+	}
+}
+
+//
+
+static const uint64_t kPrefetchChunkSize = 1024 * 1024;
+// header and tile offset tables are at the start of the file
+static const uint64_t kPrefetchHeaderSize = 256 * 1024;
+
+TexturePrefetcher::TexturePrefetcher(Logger& logger) : m_logger(logger), m_maxBytes(0), m_nextIndex(0), m_bytesPrefetched(0),
+	m_stop(false)
+{
+}
+
+TexturePrefetcher::~TexturePrefetcher()
+{
+	stop();
+}
+
+void TexturePrefetcher::start(unsigned int numThreads, size_t maxBytes)
+{
+	TextureRegistry::instance().getTexturePaths(m_aFilePaths, true);
+
+	if (m_aFilePaths.empty())
+		return;
+
+	m_maxBytes = maxBytes;
+	m_nextIndex = 0;
+	m_bytesPrefetched = 0;
+	m_stop = false;
+
+	numThreads = std::max(1u, std::min(numThreads, (unsigned int)m_aFilePaths.size()));
+
+	for (unsigned int i = 0; i < numThreads; i++)
+	{
+		m_aThreads.push_back(std::thread(&TexturePrefetcher::workerThread, this));
+	}
+}
+
+void TexturePrefetcher::stop()
+{
+	m_stop = true;
+
+	std::vector<std::thread>::iterator itThread = m_aThreads.begin();
+	for (; itThread != m_aThreads.end(); ++itThread)
+	{
+		(*itThread).join();
+	}
+
+	m_aThreads.clear();
+}
+
+void TexturePrefetcher::workerThread()
+{
+	while (!m_stop)
+	{
+		size_t index = m_nextIndex++;
+		if (index >= m_aFilePaths.size())
+			break;
+
+		if (m_bytesPrefetched >= m_maxBytes)
+			break;
+
+		prefetchFile(m_aFilePaths[index]);
+	}
+}
+
+void TexturePrefetcher::prefetchFile(const std::string& path)
+{
+	TextureFileInfo textureInfo(path);
+	TexturePreflight::readTextureHeader(textureInfo);
+
+	if (!textureInfo.exists || !textureInfo.readable)
+		return;
+
+	int fileHandle = open(path.c_str(), O_RDONLY);
+	if (fileHandle == -1)
+		return;
+
+	uint64_t fileSize = textureInfo.fileSize;
+
+	if (textureInfo.tiled && textureInfo.mipmapped && fileSize > kPrefetchHeaderSize * 4)
+	{
+		// levels are stored largest first, and all the lower levels together are roughly a third the size of the
+		// top level (so a quarter of the total), so just do the header and the end of the file.
+		uint64_t lowerLevelsSize = fileSize / 4;
+		if (prefetchRange(fileHandle, 0, kPrefetchHeaderSize))
+		{
+			prefetchRange(fileHandle, fileSize - lowerLevelsSize, lowerLevelsSize);
+		}
+	}
+	else
+	{
+		// have to do all of it
+		prefetchRange(fileHandle, 0, fileSize);
+	}
+
+	close(fileHandle);
+}
+
+bool TexturePrefetcher::prefetchRange(int fileHandle, uint64_t offset, uint64_t length)
+{
+#ifdef POSIX_FADV_WILLNEED
+	// in case the kernel can do it asynchronously itself
+	posix_fadvise(fileHandle, (off_t)offset, (off_t)length, POSIX_FADV_WILLNEED);
+#endif
+
+	// but actually read it as well, as fadvise is often ignored on network file systems
+	std::vector<char> aBuffer(std::min(length, kPrefetchChunkSize));
+
+	uint64_t endOffset = offset + length;
+	while (offset < endOffset)
+	{
+		if (m_stop || m_bytesPrefetched >= m_maxBytes)
+			return false;
+
+		size_t readSize = (size_t)std::min(endOffset - offset, kPrefetchChunkSize);
+		ssize_t bytesRead = pread(fileHandle, &aBuffer[0], readSize, (off_t)offset);
+		if (bytesRead <= 0)
+			return false;
+
+		offset += bytesRead;
+		m_bytesPrefetched += bytesRead;
+	}
+
+	return true;
+}
@@ -0,0 +1,226 @@
+/*
+ ImagineKatana
+ Copyright 2014-2019 Peter Pearson.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ You may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ ---------
+*/
+
+#ifndef TEXTURE_HELPERS_H
+#define TEXTURE_HELPERS_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+#include <sys/types.h>
+
+#include "utils/threads/mutex.h"
+
+#include "texture_conversion_cache.h"
+
+namespace Imagine
+{
+	class Logger;
+}
+
+// Keeps track of every texture path handed to Imagine by the material creation code, so that we can do things
+// with the full set of textures (validation, reporting) before Imagine lazily reads them at first shade time.
+// It's a singleton because the material creation functions are static.
+
+class TextureRegistry
+{
+public:
+	static TextureRegistry& instance();
+
+	// records the path and what it was used for, and returns the path which should be given to Imagine,
+	// which might be a converted version of the texture if the conversion cache is enabled, or a normalised
+	// UDIM path if the path contains a UDIM token.
+	std::string registerTexture(const std::string& path, const char* usage);
+
+	// original paths, or the paths of the actual files which will be used if resolved is true (with UDIM
+	// paths expanded to the tiles which exist on disk)
+	void getTexturePaths(std::vector<std::string>& aPaths, bool resolved = false) const;
+	void getTextureUsages(const std::string& path, std::vector<std::string>& aUsages) const;
+
+	size_t getTextureCount() const;
+
+	void clear();
+
+	TextureConversionCache& getConversionCache()
+	{
+		return m_conversionCache;
+	}
+
+protected:
+	TextureRegistry()
+	{
+	}
+
+	struct TextureEntry
+	{
+		std::string					resolvedPath;
+		// things it's used for (i.e. param names)
+		std::set<std::string>		usages;
+		// for UDIM textures, the individual tile files that exist
+		std::vector<std::string>	aTilePaths;
+	};
+
+	mutable Imagine::Mutex					m_lock;
+	// original path -> entry
+	std::map<std::string, TextureEntry>		m_textures;
+
+	TextureConversionCache					m_conversionCache;
+};
+
+// UDIM texture paths: we support both "<UDIM>" (and lower case) and Mari's "_MAPID_" tokens, and normalise them to
+// "<UDIM>" before passing them to Imagine, which resolves the tile from the UV coordinates at shading time and opens
+// each tile lazily through the texture cache, so only tiles which are actually hit cost anything.
+
+class UDIMHelpers
+{
+public:
+	static bool isUDIMPath(const std::string& path);
+
+	static std::string normaliseUDIMPath(const std::string& path);
+
+	// finds the tiles which exist on disk for a normalised UDIM path
+	static void getUDIMTilePaths(const std::string& normalisedPath, std::vector<std::string>& aTilePaths);
+};
+
+struct TextureFileInfo
+{
+	enum Format
+	{
+		eFormatUnknown,
+		eFormatEXR,
+		eFormatTIFF,
+		eFormatOther // not a tileable format
+	};
+
+	TextureFileInfo() : exists(false), readable(false), format(eFormatUnknown), width(0), height(0), channels(0), bytesPerChannel(0),
+		tiled(false), tileWidth(0), tileHeight(0), mipmapped(false), numMipLevels(1), fileSize(0), modifiedTime(0)
+	{
+	}
+
+	TextureFileInfo(const std::string& pth) : path(pth), exists(false), readable(false), format(eFormatUnknown), width(0), height(0), channels(0),
+		bytesPerChannel(0), tiled(false), tileWidth(0), tileHeight(0), mipmapped(false), numMipLevels(1), fileSize(0), modifiedTime(0)
+	{
+	}
+
+	// approximate size in memory of all mipmap levels once fully loaded
+	size_t getEstimatedMemorySize() const;
+
+	const char* getFormatName() const;
+
+	std::string		path;
+	std::string		error;
+
+	bool			exists;
+	bool			readable;
+	Format			format;
+
+	unsigned int	width;
+	unsigned int	height;
+	unsigned int	channels;
+	unsigned int	bytesPerChannel;
+
+	bool			tiled;
+	unsigned int	tileWidth;
+	unsigned int	tileHeight;
+	bool			mipmapped;
+	unsigned int	numMipLevels;
+
+	size_t			fileSize;
+	time_t			modifiedTime;
+};
+
+// Pre-flight validation of all registered textures: reads the file headers in parallel so that missing, scanline
+// or non-mipmapped textures can be reported before rendering, rather than render threads stalling on them mid-frame.
+
+class TexturePreflight
+{
+public:
+	TexturePreflight(Imagine::Logger& logger);
+
+	void run(unsigned int numThreads);
+
+	// prints warnings for any problem textures and a summary of the totals compared to the texture cache limits
+	void report(unsigned int cacheMemoryLimitMB, unsigned int cacheFileHandleLimit) const;
+
+	const std::vector<TextureFileInfo>& getResults() const
+	{
+		return m_aTextures;
+	}
+
+	static void readTextureHeader(TextureFileInfo& textureInfo);
+
+protected:
+	void workerThread();
+
+	static void readEXRHeader(TextureFileInfo& textureInfo);
+#ifdef HAVE_TIFF_SUPPORT
+	static void readTIFFHeader(TextureFileInfo& textureInfo);
+#endif
+
+protected:
+	Imagine::Logger&				m_logger;
+
+	std::vector<TextureFileInfo>	m_aTextures;
+	std::atomic<size_t>				m_nextIndex;
+};
+
+// Optional background prefetcher which reads texture data on its own I/O threads while the rest of the scene
+// build and rendering are happening, so that by the time render threads need texture tiles they're hopefully
+// in the OS's page cache rather than on disk / NFS. For mipmapped tiled EXRs, only the header / offset tables
+// and the lower resolution mipmap levels (which are stored at the end of the file) are prefetched, as those
+// are what most lookups for anything not close to camera will hit.
+
+class TexturePrefetcher
+{
+public:
+	TexturePrefetcher(Imagine::Logger& logger);
+	~TexturePrefetcher();
+
+	void start(unsigned int numThreads, size_t maxBytes);
+
+	// stops any prefetching which hasn't happened yet and waits for the threads
+	void stop();
+
+	uint64_t getBytesPrefetched() const
+	{
+		return m_bytesPrefetched;
+	}
+
+protected:
+	void workerThread();
+
+	void prefetchFile(const std::string& path);
+	bool prefetchRange(int fileHandle, uint64_t offset, uint64_t length);
+
+protected:
+	Imagine::Logger&				m_logger;
+
+	std::vector<std::string>		m_aFilePaths;
+	std::vector<std::thread>		m_aThreads;
+
+	size_t							m_maxBytes;
+	std::atomic<size_t>				m_nextIndex;
+	std::atomic<uint64_t>			m_bytesPrefetched;
+	std::atomic<bool>				m_stop;
+};
+
+#endif // TEXTURE_HELPERS_H